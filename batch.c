@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <netinet/udp.h>
+#include <linux/net_tstamp.h>
+
+#include "common.h"
+#include "batch.h"
+#include "pool.h"
+#include "crc32c.h"
+
+void init_send_batch(send_batch *b, int sockfd, struct sockaddr_in *addr,
+                     socklen_t addrlen, int max_count, int gso)
+{
+    memset(b, 0, sizeof(*b));
+    b->sockfd = sockfd;
+    b->addr = addr;
+    b->addrlen = addrlen;
+    b->next_addr = addr;
+    b->max_count = (max_count < 1 || max_count > BATCH_MAX) ? BATCH_MAX : max_count;
+    b->gso = gso;
+}
+
+// Closes the datagram whose iovecs were just appended and flushes a full batch
+static void finish_datagram(send_batch *b, size_t len)
+{
+    b->dgram_len[b->count] = len;
+    b->dgram_txtime[b->count] = b->next_txtime;
+    b->dgram_addr[b->count] = b->next_addr;
+    b->count++;
+    b->dgram_iov[b->count] = b->niov;
+
+    if (b->count >= b->max_count) {
+        batch_flush(b);
+    }
+}
+
+void batch_add(send_batch *b, void *buf, int len)
+{
+    b->dgram_iov[b->count] = b->niov;
+    b->iov[b->niov].iov_base = buf;
+    b->iov[b->niov].iov_len = len;
+    b->niov++;
+    finish_datagram(b, len);
+}
+
+void batch_add_segment(send_batch *b, void *hdr, int hdr_len,
+                       const void *payload, int payload_len)
+{
+    b->dgram_iov[b->count] = b->niov;
+    b->iov[b->niov].iov_base = hdr;
+    b->iov[b->niov].iov_len = hdr_len;
+    b->niov++;
+    if (payload_len > 0) {
+        b->iov[b->niov].iov_base = (void *)payload;
+        b->iov[b->niov].iov_len = payload_len;
+        b->niov++;
+    }
+    finish_datagram(b, hdr_len + payload_len);
+}
+
+int batch_enable_txtime(send_batch *b)
+{
+    struct sock_txtime cfg = {.clockid = CLOCK_MONOTONIC, .flags = 0};
+
+    if (setsockopt(b->sockfd, SOL_SOCKET, SO_TXTIME, &cfg, sizeof(cfg)) < 0) {
+        return -1;
+    }
+    b->txtime = 1;
+    return 0;
+}
+
+void batch_set_txtime(send_batch *b, uint64_t txtime_ns)
+{
+    b->next_txtime = txtime_ns;
+}
+
+void batch_set_addr(send_batch *b, struct sockaddr_in *addr)
+{
+    b->next_addr = addr;
+}
+
+// Appends a control message to message m (its msg_controllen is the space used so far)
+static void add_cmsg(send_batch *b, int m, int level, int type, const void *data, size_t len)
+{
+    struct msghdr *msg = &b->msgs[m].msg_hdr;
+    struct cmsghdr *cm = (struct cmsghdr *)(b->cmsg_buf[m] + msg->msg_controllen);
+
+    msg->msg_control = b->cmsg_buf[m];
+    cm->cmsg_level = level;
+    cm->cmsg_type = type;
+    cm->cmsg_len = CMSG_LEN(len);
+    memcpy(CMSG_DATA(cm), data, len);
+    msg->msg_controllen += CMSG_SPACE(len);
+}
+
+/*
+ * Groups the queued datagrams starting at `first` into messages. Without GSO
+ * every datagram is its own message. With GSO a message holds a run of
+ * datagrams that all have the size of the first one, except the last which
+ * may be shorter; the kernel cuts the gathered bytes back into datagrams.
+ * Returns the number of messages built; msg_first[m] is the first datagram
+ * of message m and msg_first[nmsgs] is one past the last.
+ */
+static int build_messages(send_batch *b, int first, int *msg_first)
+{
+    int m = 0;
+    int i = first;
+
+    while (i < b->count) {
+        struct msghdr *msg = &b->msgs[m].msg_hdr;
+        int run = 1;
+
+        memset(msg, 0, sizeof(*msg));
+        msg->msg_name = b->dgram_addr[i];
+        msg->msg_namelen = b->addrlen;
+        msg->msg_iov = &b->iov[b->dgram_iov[i]];
+
+        if (b->gso) {
+            size_t seg = b->dgram_len[i];
+            size_t total = seg;
+            // Extend the run while segments are full-sized and the super-datagram fits
+            while (i + run < b->count && run < GSO_MAX_SEGS &&
+                   b->dgram_len[i + run - 1] == seg &&
+                   b->dgram_len[i + run] <= seg &&
+                   b->dgram_addr[i + run] == b->dgram_addr[i] &&
+                   total + b->dgram_len[i + run] <= GSO_MAX_BYTES) {
+                total += b->dgram_len[i + run];
+                run++;
+            }
+            if (run > 1) {
+                // The kernel splits it into seg-sized datagrams
+                unsigned short gso_size = seg;
+                add_cmsg(b, m, SOL_UDP, UDP_SEGMENT, &gso_size, sizeof(gso_size));
+            }
+        }
+        if (b->txtime) {
+            add_cmsg(b, m, SOL_SOCKET, SCM_TXTIME, &b->dgram_txtime[i], sizeof(uint64_t));
+        }
+
+        msg->msg_iovlen = b->dgram_iov[i + run] - b->dgram_iov[i];
+        msg_first[m] = i;
+        i += run;
+        m++;
+    }
+    msg_first[m] = i;
+    return m;
+}
+
+void batch_flush(send_batch *b)
+{
+    int msg_first[BATCH_MAX + 1];
+    int first = 0;
+
+    while (first < b->count) {
+        int nmsgs = build_messages(b, first, msg_first);
+        int sent = sendmmsg(b->sockfd, b->msgs, nmsgs, 0);
+        b->syscalls++;
+
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (b->gso && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)) {
+                // The route does not support UDP GSO; fall back to one datagram per segment
+                VLOG(WARNING, "UDP GSO unavailable (%s), disabling", strerror(errno));
+                b->gso = 0;
+                continue;
+            }
+            error("sendmmsg");
+        }
+
+        // Resume after the last message the kernel accepted
+        b->datagrams += msg_first[sent] - first;
+        first = msg_first[sent];
+    }
+    b->count = 0;
+    b->niov = 0;
+}
+
+void init_recv_batch(recv_batch *b, int sockfd)
+{
+    memset(b, 0, sizeof(*b));
+    b->sockfd = sockfd;
+    for (int i = 0; i < BATCH_MAX; i++) {
+        b->bufs[i] = pool_acquire();
+    }
+}
+
+void *batch_take(recv_batch *b, int i)
+{
+    void *buf = b->bufs[i];
+    b->bufs[i] = pool_acquire();
+    return buf;
+}
+
+int batch_recv(recv_batch *b)
+{
+    const void *payloads[BATCH_MAX];
+    size_t lens[BATCH_MAX];
+    int n, kept = 0;
+
+    for (int i = 0; i < BATCH_MAX; i++) {
+        b->iov[i].iov_base = b->bufs[i];
+        b->iov[i].iov_len = MSS_SIZE;
+        memset(&b->msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+        b->msgs[i].msg_hdr.msg_name = &b->addrs[i];
+        b->msgs[i].msg_hdr.msg_namelen = sizeof(b->addrs[i]);
+        b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+        b->msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    // MSG_WAITFORONE: block for the first datagram, then take only what is already queued
+    do {
+        n = recvmmsg(b->sockfd, b->msgs, BATCH_MAX, MSG_WAITFORONE, NULL);
+        b->syscalls++;
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        n = 0;
+    } else if (n < 0) {
+        error("recvmmsg");
+    }
+    b->datagrams += n;
+
+    // One interleaved pass over every payload, then the intact datagrams
+    // move to the front
+    for (int i = 0; i < n; i++) {
+        payloads[i] = b->bufs[i] + TCP_HDR_SIZE;
+        lens[i] = b->msgs[i].msg_len > TCP_HDR_SIZE ? b->msgs[i].msg_len - TCP_HDR_SIZE : 0;
+    }
+    crc32c_batch(payloads, lens, b->crcs, n);
+    for (int i = 0; i < n; i++) {
+        if (!packet_intact((tcp_packet *)b->bufs[i], b->msgs[i].msg_len, b->crcs[i])) {
+            b->corrupt++;
+            continue;
+        }
+        if (kept != i) {
+            char *buf = b->bufs[kept];
+
+            b->bufs[kept] = b->bufs[i];
+            b->bufs[i] = buf;
+            b->addrs[kept] = b->addrs[i];
+            b->crcs[kept] = b->crcs[i];
+        }
+        kept++;
+    }
+    b->count = kept;
+    return kept;
+}
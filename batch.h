@@ -0,0 +1,97 @@
+#ifndef BATCH_H_INCLUDED
+#define BATCH_H_INCLUDED
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "packet.h"
+
+#define BATCH_MAX       64      // Max datagrams handed to the kernel per sendmmsg
+#define GSO_MAX_BYTES   65507   // Max UDP payload of a single GSO super-datagram
+#define GSO_MAX_SEGS    64      // Kernel limit on segments per GSO send (UDP_MAX_SEGMENTS)
+
+/*
+ * A send_batch collects datagrams and hands them to the kernel with a single
+ * sendmmsg call. A datagram is either one contiguous buffer (batch_add) or a
+ * header plus a payload gathered from elsewhere (batch_add_segment), so file
+ * data can be sent straight from where it lives. The buffers queued must
+ * stay valid until the next batch_flush.
+ *
+ * With gso enabled, runs of equally sized datagrams are coalesced into one
+ * UDP_SEGMENT super-datagram that the kernel splits back into segments.
+ *
+ * With txtime enabled (SO_TXTIME), every datagram carries the CLOCK_MONOTONIC
+ * nanosecond time it should leave at, set with batch_set_txtime before it
+ * is queued. A qdisc that honours it (fq) holds it until then, so a paced
+ * sender can hand the kernel a whole batch at once. A GSO super-datagram
+ * leaves at the time of its first segment.
+ *
+ * Datagrams go to addr unless batch_set_addr names another destination for
+ * the next ones, so one batch can carry ACKs for many peers.
+ */
+typedef struct {
+    int sockfd;
+    struct sockaddr_in *addr;
+    socklen_t addrlen;
+    int max_count;               // flush threshold (1 = one syscall per datagram)
+    int gso;                     // 1 if UDP GSO is in use
+    int txtime;                  // 1 if datagrams carry an SO_TXTIME departure time
+    uint64_t next_txtime;        // departure time of the next datagram queued
+    struct sockaddr_in *next_addr;  // destination of the next datagram queued
+
+    int count;                   // datagrams currently queued
+    int niov;                    // iovecs used by the queued datagrams
+    struct iovec iov[2 * BATCH_MAX];
+    int dgram_iov[BATCH_MAX + 1];   // first iovec of each queued datagram
+    size_t dgram_len[BATCH_MAX];    // total length of each queued datagram
+    uint64_t dgram_txtime[BATCH_MAX];  // departure time of each queued datagram
+    struct sockaddr_in *dgram_addr[BATCH_MAX];  // destination of each queued datagram
+    struct mmsghdr msgs[BATCH_MAX];
+    char cmsg_buf[BATCH_MAX][CMSG_SPACE(sizeof(unsigned short)) + CMSG_SPACE(sizeof(uint64_t))];
+
+    unsigned long syscalls;      // sendmmsg/sendmsg calls issued
+    unsigned long datagrams;     // datagrams put on the wire
+} send_batch;
+
+/*
+ * A recv_batch owns a vector of packet-pool buffers that a single recvmmsg
+ * call fills with every datagram already queued on the socket. batch_take
+ * lets the caller keep a received buffer (e.g. in a reassembly window)
+ * without copying it; the slot is refilled from the pool.
+ *
+ * batch_recv checksums the payloads of the whole batch at once
+ * (crc32c_batch) and drops every datagram that is not intact
+ * (packet_intact); the ones returned are whole, in arrival order, with
+ * their payload CRCs in crcs.
+ */
+typedef struct {
+    int sockfd;
+    int count;                           // datagrams returned by the last batch_recv
+    struct iovec iov[BATCH_MAX];
+    struct mmsghdr msgs[BATCH_MAX];
+    struct sockaddr_in addrs[BATCH_MAX]; // source address of each datagram
+    char *bufs[BATCH_MAX];               // pool blocks, at least MSS_SIZE bytes each
+    uint32_t crcs[BATCH_MAX];            // CRC32C of each datagram's payload
+
+    unsigned long syscalls;              // recvmmsg calls issued
+    unsigned long datagrams;             // datagrams received
+    unsigned long corrupt;               // of them, dropped as truncated or failing their CRC
+} recv_batch;
+
+void init_send_batch(send_batch *b, int sockfd, struct sockaddr_in *addr,
+                     socklen_t addrlen, int max_count, int gso);
+void batch_add(send_batch *b, void *buf, int len);   // queues a datagram, flushing when full
+void batch_add_segment(send_batch *b, void *hdr, int hdr_len,
+                       const void *payload, int payload_len);  // queues header + payload as one datagram
+void batch_flush(send_batch *b);                     // sends everything queued so far
+int batch_enable_txtime(send_batch *b);              // turns on SO_TXTIME; -1 if the kernel lacks it
+void batch_set_txtime(send_batch *b, uint64_t txtime_ns);  // departure time of the next datagram queued
+void batch_set_addr(send_batch *b, struct sockaddr_in *addr);  // destination of the next datagrams queued
+
+void init_recv_batch(recv_batch *b, int sockfd);
+int batch_recv(recv_batch *b);                       // waits for at least one datagram, returns how many arrived intact
+                                                     // (0 if the socket's SO_RCVTIMEO expired first, or none was)
+void *batch_take(recv_batch *b, int i);              // hands over buffer i, replacing it with a fresh one
+
+#endif
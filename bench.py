@@ -0,0 +1,208 @@
+#!/usr/bin/env python3
+"""
+Benchmark matrix for rdt_sender/rdt_receiver (run by `make bench`).
+
+Every combination of file size, channel trace, loss rate and sender window is
+transferred over loopback through link_emu. Each run records goodput,
+completion time, retransmission ratio, RTT percentiles, and the CPU time,
+context switches and syscall counts of both ends. The results are written as
+JSON so two builds can be compared number by number.
+
+The syscall counts are the ones the programs keep themselves: send and
+receive calls, event-loop calls (epoll_wait, timerfd) on the sender and
+write/sync calls on the receiver.
+"""
+import json
+import os
+import platform
+import random
+import re
+import shutil
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+from argparse import ArgumentParser
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+parser = ArgumentParser(description="benchmark matrix")
+parser.add_argument('--bin', default=os.path.join(HERE, '..', 'obj'),
+                    help="directory holding rdt_sender, rdt_receiver and link_emu")
+parser.add_argument('--out', '-o', default="bench.json",
+                    help="JSON results file")
+parser.add_argument('--sizes', type=int, nargs='+', default=[1000000, 8000000],
+                    help="file sizes in bytes")
+parser.add_argument('--traces', nargs='+', default=["highway", "rapid"],
+                    help="traces from channel_traces/ (or paths)")
+parser.add_argument('--loss', type=float, nargs='+', default=[0, 0.01],
+                    help="random loss rates on the uplink")
+parser.add_argument('--windows', type=int, nargs='+', default=[64, 128],
+                    help="sender window sizes in segments (-w)")
+parser.add_argument('--repeat', type=int, default=1,
+                    help="runs per combination")
+parser.add_argument('--delay', type=float, default=20,
+                    help="one-way propagation delay in ms")
+parser.add_argument('--queue', type=int, default=100,
+                    help="bottleneck queue in packets")
+parser.add_argument('--sender-flags', default="",
+                    help="extra rdt_sender flags, e.g. \"-c bbr -g\"")
+parser.add_argument('--receiver-flags', default="",
+                    help="extra rdt_receiver flags")
+parser.add_argument('--timeout', type=float, default=300,
+                    help="seconds before a transfer is declared hung")
+args = parser.parse_args()
+
+SENDER_PATTERNS = {
+    'datagrams':      (r"Sent (\d+) datagrams in (\d+) send syscalls", ('datagrams', None)),
+    'retransmitted':  (r"Retransmitted (\d+) of \d+ datagrams(?:, (\d+) timeouts)?",
+                       ('retransmitted', 'timeouts')),
+    'syscalls':       (r"Syscalls: (\d+) send, (\d+) recv, (\d+) event loop",
+                       ('send_syscalls', 'recv_syscalls', 'event_syscalls')),
+    'rtt':            (r"RTT p50 ([\d.]+) ms, p90 ([\d.]+) ms, p99 ([\d.]+) ms over (\d+) samples",
+                       ('rtt_p50_ms', 'rtt_p90_ms', 'rtt_p99_ms', 'rtt_samples')),
+}
+RECEIVER_PATTERNS = {
+    'syscalls':       (r"Syscalls: (\d+) recv, (\d+) send, (\d+) write",
+                       ('recv_syscalls', 'send_syscalls', 'write_syscalls')),
+}
+LINK_PATTERN = (r"uplink: (\d+) arrived, (\d+) delivered, (\d+) queue drops, (\d+) random losses"
+                r"(?:, queueing delay p50 ([\d.]+) ms p99 ([\d.]+) ms)?")
+
+
+def parse(log, patterns):
+    out = {}
+    for pattern, names in patterns.values():
+        m = re.search(pattern, log)
+        if m is None:
+            continue
+        for name, value in zip(names, m.groups()):
+            if name is not None and value is not None:
+                out[name] = float(value) if '.' in value else int(value)
+    return out
+
+
+def usage(ru):
+    return {
+        'cpu_user_s': round(ru.ru_utime, 4),
+        'cpu_sys_s': round(ru.ru_stime, 4),
+        'voluntary_ctxsw': ru.ru_nvcsw,
+        'involuntary_ctxsw': ru.ru_nivcsw,
+        'max_rss_kb': ru.ru_maxrss,
+    }
+
+
+def reap(proc, timeout):
+    """Wait for proc (killing it after timeout seconds); returns (status, rusage)"""
+    deadline = time.time() + timeout
+    while True:
+        pid, status, ru = os.wait4(proc.pid, os.WNOHANG)
+        if pid != 0:
+            proc.returncode = os.waitstatus_to_exitcode(status)
+            return proc.returncode, ru
+        if time.time() > deadline:
+            proc.kill()
+            deadline = float('inf')
+        time.sleep(0.005)
+
+
+def trace_path(name):
+    return name if os.path.exists(name) else os.path.join(HERE, 'channel_traces', name)
+
+
+def run_one(workdir, src, size, trace, loss, window, seed):
+    binary = lambda name: os.path.join(os.path.abspath(args.bin), name)
+    emu_port = random.randint(20000, 40000)
+    recv_port = emu_port + 1
+    dst = os.path.join(workdir, 'out.bin')
+    logs = {name: open(os.path.join(workdir, name + '.log'), 'w+') for name in ('sender', 'receiver', 'emu')}
+
+    receiver = subprocess.Popen([binary('rdt_receiver')] + args.receiver_flags.split() +
+                                [str(recv_port), dst], cwd=workdir, stderr=logs['receiver'])
+    emu = subprocess.Popen([binary('link_emu'), '-d', str(args.delay), '-q', str(args.queue),
+                            '-l', str(loss), '-s', str(seed), str(emu_port), '127.0.0.1',
+                            str(recv_port), trace_path(trace)], cwd=workdir, stderr=logs['emu'])
+    time.sleep(0.3)
+
+    start = time.time()
+    sender = subprocess.Popen([binary('rdt_sender')] + args.sender_flags.split() +
+                              ['-w', str(window), '127.0.0.1', str(emu_port), src],
+                              cwd=workdir, stderr=logs['sender'])
+    sender_status, sender_ru = reap(sender, args.timeout)
+    elapsed = time.time() - start
+    receiver_status, receiver_ru = reap(receiver, 2)
+    emu.send_signal(signal.SIGTERM)
+    reap(emu, 2)
+
+    for f in logs.values():
+        f.seek(0)
+    text = {name: f.read() for name, f in logs.items()}
+    for f in logs.values():
+        f.close()
+
+    ok = sender_status == 0 and os.path.exists(dst) and \
+        subprocess.call(['cmp', '-s', src, dst]) == 0
+    result = {
+        'size': size, 'trace': trace, 'loss': loss, 'window': window, 'seed': seed,
+        'ok': ok,
+        'completion_s': round(elapsed, 4),
+        'goodput_mbps': round(size * 8 / elapsed / 1e6, 3),
+        'sender': dict(parse(text['sender'], SENDER_PATTERNS), exit=sender_status, **usage(sender_ru)),
+        'receiver': dict(parse(text['receiver'], RECEIVER_PATTERNS), exit=receiver_status, **usage(receiver_ru)),
+    }
+    s = result['sender']
+    if s.get('datagrams'):
+        result['retransmission_ratio'] = round(s.get('retransmitted', 0) / s['datagrams'], 5)
+    m = re.search(LINK_PATTERN, text['emu'])
+    if m is not None:
+        g = m.groups()
+        result['link'] = {'arrived': int(g[0]), 'delivered': int(g[1]),
+                          'queue_drops': int(g[2]), 'random_losses': int(g[3])}
+        if g[4] is not None:
+            result['link'].update(qdelay_p50_ms=float(g[4]), qdelay_p99_ms=float(g[5]))
+    return result
+
+
+def git_revision():
+    try:
+        return subprocess.check_output(['git', 'rev-parse', '--short', 'HEAD'], cwd=HERE,
+                                       stderr=subprocess.DEVNULL, text=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+workdir = tempfile.mkdtemp(prefix='rdt_bench.')
+runs = []
+try:
+    for size in args.sizes:
+        src = os.path.join(workdir, 'in_%d.bin' % size)
+        with open(src, 'wb') as f:
+            f.write(random.Random(size).randbytes(size))
+        for trace in args.traces:
+            for loss in args.loss:
+                for window in args.windows:
+                    for rep in range(args.repeat):
+                        r = run_one(workdir, src, size, trace, loss, window, rep + 1)
+                        runs.append(r)
+                        print("%-8s %9d B loss %.3f w %4d: %s %7.2f s %7.2f Mbit/s retx %.4f "
+                              "RTT p50 %s p99 %s ms, CPU %.2f s"
+                              % (trace, size, loss, window, 'ok  ' if r['ok'] else 'FAIL',
+                                 r['completion_s'], r['goodput_mbps'], r.get('retransmission_ratio', 0),
+                                 r['sender'].get('rtt_p50_ms'), r['sender'].get('rtt_p99_ms'),
+                                 r['sender']['cpu_user_s'] + r['sender']['cpu_sys_s']))
+                        sys.stdout.flush()
+finally:
+    shutil.rmtree(workdir, ignore_errors=True)
+
+with open(args.out, 'w') as f:
+    json.dump({
+        'revision': git_revision(),
+        'host': platform.node(),
+        'date': time.strftime('%Y-%m-%dT%H:%M:%S'),
+        'config': {'delay_ms': args.delay, 'queue': args.queue,
+                   'sender_flags': args.sender_flags, 'receiver_flags': args.receiver_flags},
+        'runs': runs,
+    }, f, indent=2)
+print("Wrote %d runs to %s" % (len(runs), args.out))
+sys.exit(0 if all(r['ok'] for r in runs) else 1)
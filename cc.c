@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+#include "packet.h"
+#include "cc.h"
+
+// Every selectable algorithm; the first one is the default
+static const cc_ops *cc_modules[] = {
+    &reno_ops,
+    &cubic_ops,
+    &bbr_ops,
+    &copa_ops,
+    NULL
+};
+
+int cc_init(cc_ctx *cc, const char *name, double knob)
+{
+    memset(cc, 0, sizeof(*cc));
+    cc->knob = knob;
+    cc->cwnd = 1.0;
+    cc->ssthresh = 64;
+    cc->state = SLOW_START;
+
+    for (int i = 0; cc_modules[i] != NULL; i++) {
+        if (name == NULL || strcmp(name, cc_modules[i]->name) == 0) {
+            cc->ops = cc_modules[i];
+            if (cc->ops->init != NULL) {
+                cc->ops->init(cc);
+            }
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void cc_release(cc_ctx *cc)
+{
+    if (cc->ops != NULL && cc->ops->release != NULL) {
+        cc->ops->release(cc);
+    }
+}
+
+/*
+ * Proportional Rate Reduction (RFC 6937) with the slow-start reduction bound:
+ * while more than ssthresh segments are in flight, send in proportion to the
+ * data delivered, so the window falls smoothly from the flight size to
+ * ssthresh over one round trip instead of stalling for half of it; once the
+ * pipe has drained below ssthresh, grow back towards it like slow start but
+ * never more than one segment beyond what was delivered.
+ */
+static void prr_on_ack(cc_ctx *cc, const cc_sample *rs)
+{
+    int sndcnt;
+
+    cc->prr_delivered += rs->delivered_segments;
+    if (rs->in_flight > cc->ssthresh) {
+        sndcnt = (int)ceil((double)cc->prr_delivered * cc->ssthresh / cc->recover_fs) - cc->prr_out;
+    } else {
+        int limit = cc->prr_delivered - cc->prr_out;
+
+        if (limit < rs->delivered_segments) {
+            limit = rs->delivered_segments;
+        }
+        sndcnt = cc->ssthresh - rs->in_flight;
+        if (sndcnt > limit + 1) {
+            sndcnt = limit + 1;
+        }
+    }
+    if (sndcnt < 0) {
+        sndcnt = 0;
+    }
+    cc->cwnd = rs->in_flight + sndcnt;
+    VLOG(DEBUG, "PRR: delivered %d, out %d, CWND %.2f", cc->prr_delivered, cc->prr_out, cc->cwnd);
+}
+
+void cc_on_ack(cc_ctx *cc, const cc_sample *rs, uint64_t now_us)
+{
+    int64_t rtt_us = rs->rtt_us;
+
+    if (rtt_us > 0) {
+        // Smoothed RTT with gain 1/8 as in RFC 6298, plus the minimum
+        cc->srtt_us = cc->srtt_us == 0 ? rtt_us : cc->srtt_us + (rtt_us - cc->srtt_us) / 8;
+        if (cc->min_rtt_us == 0 || rtt_us < cc->min_rtt_us) {
+            cc->min_rtt_us = rtt_us;
+        }
+    }
+    if (cc->state == FAST_RETRANSMIT) {
+        prr_on_ack(cc, rs);
+        return;
+    }
+    cc->ops->on_ack(cc, rs, now_us);
+}
+
+void cc_on_loss(cc_ctx *cc, int flight_size, uint64_t now_us)
+{
+    cc->ops->on_loss(cc, now_us);
+    cc->recover_fs = flight_size > 0 ? flight_size : 1;
+    cc->prr_delivered = 0;
+    cc->prr_out = 0;
+}
+
+// Recovery is over: resume congestion avoidance from ssthresh (RFC 6937)
+void cc_end_recovery(cc_ctx *cc)
+{
+    cc->in_recovery = 0;
+    if (cc->state == FAST_RETRANSMIT) {
+        cc->cwnd = cc->ssthresh;
+        cc->state = CONGESTION_AVOIDANCE;
+    }
+}
+
+void cc_on_timeout(cc_ctx *cc, uint64_t now_us)
+{
+    cc->ops->on_timeout(cc, now_us);
+}
+
+double cc_pacing_rate(cc_ctx *cc)
+{
+    if (cc->ops->pacing_rate != NULL) {
+        return cc->ops->pacing_rate(cc);
+    }
+    if (!cc->pace_window) {
+        return 0;
+    }
+    // Spread the window over the RTT, with headroom as in Linux: twice the
+    // window rate in slow start so pacing does not slow the doubling, 1.2x after
+    return (cc->state == SLOW_START ? 2.0 : 1.2) * cc_window_rate(cc);
+}
+
+const char *cc_names()
+{
+    static char names[128];
+
+    if (names[0] == '\0') {
+        for (int i = 0; cc_modules[i] != NULL; i++) {
+            if (i > 0) {
+                strcat(names, "|");
+            }
+            strcat(names, cc_modules[i]->name);
+        }
+    }
+    return names;
+}
+
+// In slow start, increment CWND by 1 for each acknowledged segment
+// This causes exponential growth (doubles each RTT)
+void reno_slow_start(cc_ctx *cc, int acked_segments)
+{
+    cc->cwnd += acked_segments;
+    VLOG(DEBUG, "Slow start: Increasing CWND to %.2f", cc->cwnd);
+
+    // Check if we should transition to congestion avoidance
+    if (cc->cwnd >= cc->ssthresh) {
+        cc->state = CONGESTION_AVOIDANCE;
+        VLOG(DEBUG, "Transitioning to Congestion Avoidance");
+    }
+}
+
+// The rate at which cwnd would drain in one smoothed RTT, in bytes per second
+// (0 before the first RTT sample)
+double cc_window_rate(cc_ctx *cc)
+{
+    if (cc->srtt_us == 0) {
+        return 0;
+    }
+    return cc->cwnd * DATA_SIZE * 1e6 / cc->srtt_us;
+}
+
+/*
+ * Reno: slow start up to ssthresh, then one segment per RTT. The receiver
+ * ACKs once per batch, so growth counts acknowledged segments (RFC 3465)
+ * rather than ACKs.
+ */
+static void reno_on_ack(cc_ctx *cc, const cc_sample *rs, uint64_t now_us)
+{
+    int acked_segments = rs->acked_segments;
+
+    if (cc->state == SLOW_START) {
+        reno_slow_start(cc, acked_segments);
+    } else if (cc->state == CONGESTION_AVOIDANCE) {
+        // In congestion avoidance, increase CWND by 1/CWND for each acknowledged segment
+        // This results in linear growth of ~1 packet per RTT
+        cc->cwnd += (float)acked_segments / cc->cwnd;
+        VLOG(DEBUG, "Congestion avoidance: Increasing CWND to %.2f", cc->cwnd);
+    }
+}
+
+// Halve the window through PRR fast recovery rather than restarting from one
+static void reno_on_loss(cc_ctx *cc, uint64_t now_us)
+{
+    cc->ssthresh = (int)fmax(cc->cwnd / 2, 2);
+    cc->state = FAST_RETRANSMIT;
+}
+
+static void reno_on_timeout(cc_ctx *cc, uint64_t now_us)
+{
+    cc->ssthresh = (int)fmax(cc->cwnd / 2, 2);
+    cc->cwnd = 1.0;
+    cc->state = SLOW_START;
+}
+
+const cc_ops reno_ops = {
+    .name = "reno",
+    .on_ack = reno_on_ack,
+    .on_loss = reno_on_loss,
+    .on_timeout = reno_on_timeout,
+};
@@ -0,0 +1,89 @@
+#ifndef CC_H_INCLUDED
+#define CC_H_INCLUDED
+
+#include <stdint.h>
+
+// Congestion control states. A module's on_loss enters FAST_RETRANSMIT to
+// have the window through recovery set by Proportional Rate Reduction.
+// Modules that keep their own window through recovery (bbr, copa) still
+// report SLOW_START or CONGESTION_AVOIDANCE, for the sender's statistics
+#define SLOW_START 0
+#define CONGESTION_AVOIDANCE 1
+#define FAST_RETRANSMIT 2
+
+typedef struct cc_ops cc_ops;
+
+/*
+ * What one ACK told the sender. The delivery rate is measured over the
+ * interval from the delivery snapshot taken when the most recently sent of
+ * the newly delivered segments left, to now.
+ */
+typedef struct {
+    int acked_segments;         // segments newly covered by the cumulative ACK
+    int delivered_segments;     // segments newly ACKed or SACKed
+    int64_t rtt_us;             // RTT sample, -1 when the ACK gave none
+    double delivery_rate;       // bytes per second, 0 when the ACK gave no sample
+    int64_t interval_us;        // length of the delivery-rate interval
+    uint64_t delivered;         // total bytes delivered so far
+    uint64_t prior_delivered;   // bytes delivered when the sampled segment was sent
+    int in_flight;              // segments in the network after this ACK
+} cc_sample;
+
+/*
+ * Congestion control state shared by every algorithm. The sender only reads
+ * cwnd (and the pacing rate); everything that changes it goes through the
+ * module's ops table. Algorithm-specific state hangs off priv.
+ */
+typedef struct {
+    const cc_ops *ops;
+    float cwnd;              // Congestion window size (in packets)
+    int ssthresh;            // Slow start threshold (in packets)
+    int state;               // SLOW_START, CONGESTION_AVOIDANCE or FAST_RETRANSMIT
+    int in_recovery;         // Set by the sender while loss recovery is in progress
+    int recover_fs;          // PRR: segments outstanding when recovery started
+    int prr_delivered;       // PRR: segments delivered since then
+    int prr_out;             // PRR: segments sent since then (counted by the sender)
+    int64_t srtt_us;         // Smoothed RTT, 0 until the first sample
+    int64_t min_rtt_us;      // Lowest RTT seen, 0 until the first sample
+    double knob;             // Module-specific tunable (-k), 0 for the module's default
+    int pace_window;         // Pace modules without a pacing_rate at cwnd/SRTT
+    void *priv;
+} cc_ctx;
+
+/*
+ * One congestion control algorithm. on_ack runs for every ACK that
+ * acknowledges or SACKs new data, except in FAST_RETRANSMIT where PRR owns
+ * the window. on_loss runs when loss recovery starts, on_timeout when the
+ * retransmission timer fires. pacing_rate returns the send rate in bytes per
+ * second; modules without one (or returning 0) are ACK-clocked, or paced off
+ * cwnd/SRTT when pace_window is set.
+ */
+struct cc_ops {
+    const char *name;
+    void (*init)(cc_ctx *cc);
+    void (*release)(cc_ctx *cc);
+    void (*on_ack)(cc_ctx *cc, const cc_sample *rs, uint64_t now_us);
+    void (*on_loss)(cc_ctx *cc, uint64_t now_us);
+    void (*on_timeout)(cc_ctx *cc, uint64_t now_us);
+    double (*pacing_rate)(cc_ctx *cc);
+};
+
+extern const cc_ops reno_ops;
+extern const cc_ops cubic_ops;
+extern const cc_ops bbr_ops;
+extern const cc_ops copa_ops;
+
+int cc_init(cc_ctx *cc, const char *name, double knob); // returns -1 for an unknown algorithm
+void cc_release(cc_ctx *cc);
+void cc_on_ack(cc_ctx *cc, const cc_sample *rs, uint64_t now_us);
+void cc_on_loss(cc_ctx *cc, int flight_size, uint64_t now_us);
+void cc_end_recovery(cc_ctx *cc);
+void cc_on_timeout(cc_ctx *cc, uint64_t now_us);
+double cc_pacing_rate(cc_ctx *cc);           // bytes per second, 0 = not paced
+const char *cc_names();                      // "reno|cubic|...", for usage messages
+
+// Building blocks shared by the modules
+void reno_slow_start(cc_ctx *cc, int acked_segments);
+double cc_window_rate(cc_ctx *cc);           // cwnd segments per smoothed RTT
+
+#endif
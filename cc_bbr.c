@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "common.h"
+#include "packet.h"
+#include "cc.h"
+
+/*
+ * BBR-style model-based congestion control (after BBR v1).
+ *
+ * Instead of reacting to loss, it keeps a model of the path: the bottleneck
+ * bandwidth (windowed max of the delivery rate over the last BBR_BW_ROUNDS
+ * round trips) and the propagation delay (windowed min RTT over
+ * BBR_MIN_RTT_WIN_US). Segments are paced at pacing_gain x bandwidth and
+ * cwnd is capped at cwnd_gain x BDP, so the bottleneck stays busy without a
+ * standing queue. The gains follow a state machine:
+ *
+ *   STARTUP    gain 2.885 until the bandwidth stops growing 25% per round
+ *   DRAIN      inverse gain until the queue STARTUP built is gone
+ *   PROBE_BW   cycles 1.25, 0.75, 1 x 6, one phase per min RTT, to
+ *              discover new bandwidth and then drain what the probe queued
+ *   PROBE_RTT  cwnd 4 for 200 ms when the min RTT has not been refreshed
+ *              for 10 s, to let the queue empty and re-measure it
+ */
+#define BBR_STARTUP   0
+#define BBR_DRAIN     1
+#define BBR_PROBE_BW  2
+#define BBR_PROBE_RTT 3
+
+#define BBR_HIGH_GAIN        2.885      // 2/ln(2): doubles the rate every round
+#define BBR_CWND_GAIN        2.0
+#define BBR_BW_ROUNDS        10         // Bandwidth filter length in round trips
+#define BBR_MIN_RTT_WIN_US   10000000   // Min RTT filter length
+#define BBR_PROBE_RTT_US     200000     // Time spent at BBR_MIN_CWND in PROBE_RTT
+#define BBR_MIN_CWND         4
+#define BBR_INITIAL_CWND     10
+#define BBR_CYCLE_LEN        8
+
+static const double probe_bw_gains[BBR_CYCLE_LEN] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+
+typedef struct {
+    int mode;
+    double pacing_gain;
+    double cwnd_gain;
+
+    // Bottleneck bandwidth: max delivery rate of each of the last rounds
+    double bw_rounds[BBR_BW_ROUNDS];
+    double btl_bw;                  // bytes per second
+    uint64_t round;                 // round trips counted so far
+    uint64_t next_round_delivered;  // a round ends once this much has been delivered
+
+    // Propagation delay
+    int64_t min_rtt_us;
+    uint64_t min_rtt_stamp;         // when min_rtt_us was last refreshed
+    int min_rtt_expired;            // the last ACK found it older than BBR_MIN_RTT_WIN_US
+
+    // STARTUP exit: bandwidth plateau detection
+    double full_bw;
+    int full_bw_rounds;
+    int filled_pipe;
+
+    int cycle_idx;                  // PROBE_BW phase
+    uint64_t cycle_stamp;
+
+    uint64_t probe_rtt_done;        // PROBE_RTT end time, 0 until cwnd has drained
+    uint64_t probe_rtt_round;       // round PROBE_RTT must also see end
+    double prior_cwnd;              // cwnd to restore after PROBE_RTT
+} bbr_state;
+
+static void bbr_init(cc_ctx *cc)
+{
+    bbr_state *b = calloc(1, sizeof(bbr_state));
+
+    if (b == NULL) {
+        error("calloc");
+    }
+    b->mode = BBR_STARTUP;
+    b->pacing_gain = BBR_HIGH_GAIN;
+    b->cwnd_gain = BBR_HIGH_GAIN;
+    cc->priv = b;
+    cc->cwnd = BBR_INITIAL_CWND;
+}
+
+static void bbr_release(cc_ctx *cc)
+{
+    free(cc->priv);
+    cc->priv = NULL;
+}
+
+// Estimated bandwidth-delay product in segments, 0 until the model has both halves
+static double bbr_bdp(bbr_state *b)
+{
+    if (b->btl_bw == 0 || b->min_rtt_us == 0) {
+        return 0;
+    }
+    return b->btl_bw * b->min_rtt_us / 1e6 / DATA_SIZE;
+}
+
+static void bbr_enter_probe_bw(bbr_state *b, uint64_t now_us)
+{
+    b->mode = BBR_PROBE_BW;
+    b->cwnd_gain = BBR_CWND_GAIN;
+    b->cycle_idx = 2;  // Start in a cruising phase, right after the drain
+    b->cycle_stamp = now_us;
+    b->pacing_gain = probe_bw_gains[b->cycle_idx];
+}
+
+static void bbr_update_model(bbr_state *b, const cc_sample *rs, uint64_t now_us, int *round_start)
+{
+    // A round trip ends when a segment sent after the previous round ended is delivered
+    *round_start = 0;
+    if (rs->delivered_segments > 0 && rs->prior_delivered >= b->next_round_delivered) {
+        b->next_round_delivered = rs->delivered;
+        b->round++;
+        b->bw_rounds[b->round % BBR_BW_ROUNDS] = 0;
+        *round_start = 1;
+    }
+
+    // Samples over less than a min RTT are ACK-compression artefacts
+    if (rs->delivery_rate > 0 && rs->interval_us >= b->min_rtt_us) {
+        double *slot = &b->bw_rounds[b->round % BBR_BW_ROUNDS];
+
+        if (rs->delivery_rate > *slot) {
+            *slot = rs->delivery_rate;
+        }
+        b->btl_bw = 0;
+        for (int i = 0; i < BBR_BW_ROUNDS; i++) {
+            if (b->bw_rounds[i] > b->btl_bw) {
+                b->btl_bw = b->bw_rounds[i];
+            }
+        }
+    }
+
+    // An expired minimum is replaced by whatever the current RTT is
+    b->min_rtt_expired = b->min_rtt_stamp != 0 && now_us - b->min_rtt_stamp > BBR_MIN_RTT_WIN_US;
+    if (rs->rtt_us > 0 && (b->min_rtt_us == 0 || rs->rtt_us <= b->min_rtt_us || b->min_rtt_expired)) {
+        b->min_rtt_us = rs->rtt_us;
+        b->min_rtt_stamp = now_us;
+    }
+
+    // STARTUP is over once three rounds in a row fail to grow the bandwidth by 25%
+    if (*round_start && !b->filled_pipe && b->btl_bw > 0) {
+        if (b->btl_bw >= b->full_bw * 1.25) {
+            b->full_bw = b->btl_bw;
+            b->full_bw_rounds = 0;
+        } else if (++b->full_bw_rounds >= 3) {
+            b->filled_pipe = 1;
+        }
+    }
+}
+
+static void bbr_update_mode(cc_ctx *cc, bbr_state *b, const cc_sample *rs, uint64_t now_us)
+{
+    double bdp = bbr_bdp(b);
+
+    if (b->mode == BBR_STARTUP && b->filled_pipe) {
+        b->mode = BBR_DRAIN;
+        b->pacing_gain = 1 / BBR_HIGH_GAIN;
+        b->cwnd_gain = BBR_HIGH_GAIN;
+        VLOG(DEBUG, "BBR: drain, bw %.0f B/s, min RTT %ld us", b->btl_bw, (long)b->min_rtt_us);
+    }
+    if (b->mode == BBR_DRAIN && rs->in_flight <= bdp) {
+        bbr_enter_probe_bw(b, now_us);
+    }
+
+    if (b->mode == BBR_PROBE_BW && now_us - b->cycle_stamp > (uint64_t)b->min_rtt_us) {
+        b->cycle_idx = (b->cycle_idx + 1) % BBR_CYCLE_LEN;
+        b->cycle_stamp = now_us;
+        b->pacing_gain = probe_bw_gains[b->cycle_idx];
+    } else if (b->mode == BBR_PROBE_BW && b->pacing_gain < 1 && rs->in_flight <= bdp) {
+        // The drain phase can end early once the probe's queue is gone
+        b->cycle_idx = (b->cycle_idx + 1) % BBR_CYCLE_LEN;
+        b->cycle_stamp = now_us;
+        b->pacing_gain = probe_bw_gains[b->cycle_idx];
+    }
+
+    // Re-measure the propagation delay if it has not been seen for a while
+    if (b->mode != BBR_PROBE_RTT && b->min_rtt_expired) {
+        b->mode = BBR_PROBE_RTT;
+        b->pacing_gain = 1;
+        b->prior_cwnd = cc->cwnd;
+        b->probe_rtt_done = 0;
+        VLOG(DEBUG, "BBR: probe RTT");
+    }
+    if (b->mode == BBR_PROBE_RTT) {
+        if (b->probe_rtt_done == 0 && rs->in_flight <= BBR_MIN_CWND) {
+            b->probe_rtt_done = now_us + BBR_PROBE_RTT_US;
+            b->probe_rtt_round = b->round + 1;
+        } else if (b->probe_rtt_done != 0 && now_us >= b->probe_rtt_done &&
+                   b->round >= b->probe_rtt_round) {
+            b->min_rtt_stamp = now_us;
+            if (cc->cwnd < b->prior_cwnd) {
+                cc->cwnd = b->prior_cwnd;
+            }
+            if (b->filled_pipe) {
+                bbr_enter_probe_bw(b, now_us);
+            } else {
+                b->mode = BBR_STARTUP;
+                b->pacing_gain = BBR_HIGH_GAIN;
+                b->cwnd_gain = BBR_HIGH_GAIN;
+            }
+        }
+    }
+
+    // Only STARTUP grows the window exponentially; rdt_stat counts the rest as avoidance
+    cc->state = b->mode == BBR_STARTUP ? SLOW_START : CONGESTION_AVOIDANCE;
+}
+
+static void bbr_on_ack(cc_ctx *cc, const cc_sample *rs, uint64_t now_us)
+{
+    bbr_state *b = cc->priv;
+    int round_start;
+    double target;
+
+    bbr_update_model(b, rs, now_us, &round_start);
+    bbr_update_mode(cc, b, rs, now_us);
+
+    // Grow by what was delivered, up to cwnd_gain x BDP
+    target = b->cwnd_gain * bbr_bdp(b);
+    if (b->filled_pipe && target > 0) {
+        cc->cwnd = fmin(cc->cwnd + rs->delivered_segments, target);
+    } else if (target == 0 || cc->cwnd < target) {
+        cc->cwnd += rs->delivered_segments;
+    }
+    if (cc->cwnd < BBR_MIN_CWND) {
+        cc->cwnd = BBR_MIN_CWND;
+    }
+    if (b->mode == BBR_PROBE_RTT && cc->cwnd > BBR_MIN_CWND) {
+        cc->cwnd = BBR_MIN_CWND;
+    }
+}
+
+// Loss is not a congestion signal for the model; recovery just repairs it
+static void bbr_on_loss(cc_ctx *cc, uint64_t now_us)
+{
+}
+
+// After a timeout nothing is known to be in flight: restart from one
+// segment and let the delivered data grow cwnd back towards the model
+static void bbr_on_timeout(cc_ctx *cc, uint64_t now_us)
+{
+    cc->cwnd = 1;
+}
+
+static double bbr_pacing_rate(cc_ctx *cc)
+{
+    bbr_state *b = cc->priv;
+
+    if (b->btl_bw == 0) {
+        // No bandwidth sample yet: pace the initial window over the RTT seen so far
+        return b->pacing_gain * cc_window_rate(cc);
+    }
+    return b->pacing_gain * b->btl_bw;
+}
+
+const cc_ops bbr_ops = {
+    .name = "bbr",
+    .init = bbr_init,
+    .release = bbr_release,
+    .on_ack = bbr_on_ack,
+    .on_loss = bbr_on_loss,
+    .on_timeout = bbr_on_timeout,
+    .pacing_rate = bbr_pacing_rate,
+};
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "common.h"
+#include "packet.h"
+#include "cc.h"
+
+/*
+ * Copa-style delay-based congestion control (default mode of Copa, NSDI '18).
+ *
+ * The queueing delay d_q is the standing RTT (the lowest RTT of the last half
+ * smoothed RTT, which filters out ACK jitter) minus the min RTT. The flow
+ * aims for a send rate of
+ *     target = 1 / (delta * d_q)    segments per second
+ * so in equilibrium it keeps about 1/delta segments queued at the bottleneck.
+ * Each ACK moves cwnd by v / (delta * cwnd) towards the target. The
+ * velocity v is 1 while the window changes direction; once it has moved the
+ * same way for three round trips, v doubles every further round trip, so
+ * large changes in capacity are tracked within a few RTTs.
+ *
+ * delta is the latency/throughput knob (-k): larger values hold a smaller
+ * queue and react sooner; smaller values queue more and give up less
+ * throughput on paths whose capacity fluctuates. Loss does not change the
+ * window, only a timeout does.
+ */
+#define COPA_DEFAULT_DELTA 0.5
+#define COPA_MIN_CWND      2
+#define COPA_INITIAL_CWND  10
+#define COPA_MIN_RTT_WIN_US 10000000  // Min RTT filter length, as in BBR
+#define COPA_MAX_VELOCITY  64
+
+typedef struct {
+    double delta;
+
+    // Standing RTT: min RTT over two back-to-back buckets of srtt/4 each
+    int64_t standing_cur, standing_prev;
+    uint64_t bucket_start;
+
+    // Propagation delay: min RTT of the last COPA_MIN_RTT_WIN_US
+    int64_t min_rtt_us;
+    uint64_t min_rtt_stamp;
+
+    int slow_start;           // Double per RTT until the rate first exceeds the target
+
+    // Velocity: direction of the last round trip and how many in a row went that way
+    double velocity;
+    int direction;            // +1 up, -1 down
+    int same_direction_rounds;
+    double round_start_cwnd;
+    uint64_t round_start;
+} copa_state;
+
+static void copa_init(cc_ctx *cc)
+{
+    copa_state *c = calloc(1, sizeof(copa_state));
+
+    if (c == NULL) {
+        error("calloc");
+    }
+    c->delta = cc->knob > 0 ? cc->knob : COPA_DEFAULT_DELTA;
+    c->slow_start = 1;
+    c->velocity = 1;
+    c->direction = 1;
+    cc->priv = c;
+    cc->cwnd = COPA_INITIAL_CWND;
+}
+
+static void copa_release(cc_ctx *cc)
+{
+    free(cc->priv);
+    cc->priv = NULL;
+}
+
+static void copa_update_rtt(cc_ctx *cc, copa_state *c, int64_t rtt_us, uint64_t now_us)
+{
+    int64_t bucket_us = cc->srtt_us / 4;
+
+    if (now_us - c->bucket_start > (uint64_t)bucket_us) {
+        c->standing_prev = c->standing_cur;
+        c->standing_cur = 0;
+        c->bucket_start = now_us;
+    }
+    if (c->standing_cur == 0 || rtt_us < c->standing_cur) {
+        c->standing_cur = rtt_us;
+    }
+
+    if (c->min_rtt_us == 0 || rtt_us <= c->min_rtt_us ||
+        now_us - c->min_rtt_stamp > COPA_MIN_RTT_WIN_US) {
+        c->min_rtt_us = rtt_us;
+        c->min_rtt_stamp = now_us;
+    }
+}
+
+static int64_t copa_standing_rtt(copa_state *c)
+{
+    if (c->standing_prev != 0 && c->standing_prev < c->standing_cur) {
+        return c->standing_prev;
+    }
+    return c->standing_cur;
+}
+
+// Once per round trip, speed up if cwnd keeps moving the same way
+static void copa_update_velocity(cc_ctx *cc, copa_state *c, uint64_t now_us)
+{
+    int direction;
+
+    if (now_us - c->round_start < (uint64_t)cc->srtt_us) {
+        return;
+    }
+    direction = cc->cwnd >= c->round_start_cwnd ? 1 : -1;
+    if (direction != c->direction) {
+        c->direction = direction;
+        c->same_direction_rounds = 0;
+        c->velocity = 1;
+    } else if (++c->same_direction_rounds >= 3 && c->velocity < COPA_MAX_VELOCITY) {
+        c->velocity *= 2;
+    }
+    c->round_start = now_us;
+    c->round_start_cwnd = cc->cwnd;
+}
+
+static void copa_on_ack(cc_ctx *cc, const cc_sample *rs, uint64_t now_us)
+{
+    copa_state *c = cc->priv;
+    int64_t standing, queue_us;
+    double rate, target, step;
+
+    if (rs->rtt_us > 0) {
+        copa_update_rtt(cc, c, rs->rtt_us, now_us);
+    }
+    standing = copa_standing_rtt(c);
+    if (standing == 0 || rs->delivered_segments == 0) {
+        return;
+    }
+
+    // Rates in segments per second; no queue means no limit
+    queue_us = standing - c->min_rtt_us;
+    rate = cc->cwnd * 1e6 / standing;
+    target = queue_us > 0 ? 1e6 / (c->delta * queue_us) : INFINITY;
+
+    if (c->slow_start) {
+        if (rate <= target) {
+            cc->cwnd += rs->delivered_segments;
+            return;
+        }
+        c->slow_start = 0;
+        cc->state = CONGESTION_AVOIDANCE;
+        c->round_start = now_us;
+        c->round_start_cwnd = cc->cwnd;
+    }
+
+    copa_update_velocity(cc, c, now_us);
+    step = c->velocity * rs->delivered_segments / (c->delta * cc->cwnd);
+    if (rate <= target) {
+        cc->cwnd += step;
+    } else {
+        cc->cwnd -= step;
+    }
+    if (cc->cwnd < COPA_MIN_CWND) {
+        cc->cwnd = COPA_MIN_CWND;
+    }
+    VLOG(DEBUG, "Copa: CWND %.2f, standing RTT %ld us, queue %ld us, v %.0f",
+         cc->cwnd, (long)standing, (long)queue_us, c->velocity);
+}
+
+// The delay signal already keeps the queue short; a loss is just repaired
+static void copa_on_loss(cc_ctx *cc, uint64_t now_us)
+{
+}
+
+static void copa_on_timeout(cc_ctx *cc, uint64_t now_us)
+{
+    copa_state *c = cc->priv;
+
+    cc->cwnd = 1;
+    c->slow_start = 1;
+    cc->state = SLOW_START;
+    c->velocity = 1;
+    c->same_direction_rounds = 0;
+}
+
+// Pace at twice cwnd per standing RTT, so the window, not the pacer, limits
+// the rate while ACK-clocked departures are still spread out
+static double copa_pacing_rate(cc_ctx *cc)
+{
+    copa_state *c = cc->priv;
+    int64_t standing = copa_standing_rtt(c);
+
+    if (standing == 0) {
+        return 0;
+    }
+    return 2 * cc->cwnd * DATA_SIZE * 1e6 / standing;
+}
+
+const cc_ops copa_ops = {
+    .name = "copa",
+    .init = copa_init,
+    .release = copa_release,
+    .on_ack = copa_on_ack,
+    .on_loss = copa_on_loss,
+    .on_timeout = copa_on_timeout,
+    .pacing_rate = copa_pacing_rate,
+};
@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "common.h"
+#include "cc.h"
+
+/*
+ * CUBIC (RFC 9438). After a loss the window follows
+ *     W(t) = C * (t - K)^3 + W_max
+ * where t is the time since the loss, so it regrows quickly towards the
+ * window where the loss happened, plateaus around it, then probes beyond
+ * it. The growth depends on elapsed time rather than on the ACK rate, so
+ * long-RTT, high-bandwidth paths refill far faster than with Reno's one
+ * segment per RTT. A Reno estimate (W_est) keeps it at least as aggressive
+ * as Reno on short paths.
+ */
+#define CUBIC_C    0.4   // Scaling constant, segments / s^3
+#define CUBIC_BETA 0.7   // Multiplicative decrease factor
+
+typedef struct {
+    double w_max;           // Window just before the last reduction
+    double k;               // Seconds the cubic takes to climb back to w_max
+    double origin;          // Plateau of the current cubic
+    double w_est;           // Reno-friendly window estimate
+    uint64_t epoch_start;   // When the current growth epoch began, 0 = not started
+} cubic_state;
+
+static void cubic_init(cc_ctx *cc)
+{
+    cc->priv = calloc(1, sizeof(cubic_state));
+    if (cc->priv == NULL) {
+        error("calloc");
+    }
+}
+
+static void cubic_release(cc_ctx *cc)
+{
+    free(cc->priv);
+    cc->priv = NULL;
+}
+
+static void cubic_on_ack(cc_ctx *cc, const cc_sample *rs, uint64_t now_us)
+{
+    cubic_state *cs = cc->priv;
+    int acked_segments = rs->acked_segments;
+    double t, target;
+
+    if (cc->state == SLOW_START) {
+        reno_slow_start(cc, acked_segments);
+        return;
+    }
+
+    if (cs->epoch_start == 0) {
+        cs->epoch_start = now_us;
+        cs->w_est = cc->cwnd;
+        if (cc->cwnd < cs->w_max) {
+            cs->k = cbrt((cs->w_max - cc->cwnd) / CUBIC_C);
+            cs->origin = cs->w_max;
+        } else {
+            cs->k = 0;
+            cs->origin = cc->cwnd;
+        }
+    }
+
+    // Aim for where the curve will be one RTT from now
+    t = (now_us - cs->epoch_start + cc->min_rtt_us) / 1e6;
+    target = cs->origin + CUBIC_C * pow(t - cs->k, 3);
+    if (target > 1.5 * cc->cwnd) {
+        target = 1.5 * cc->cwnd;
+    }
+
+    if (target > cc->cwnd) {
+        // One batch ACK can cover more than a window; do not overshoot the curve
+        cc->cwnd = fmin(cc->cwnd + (target - cc->cwnd) / cc->cwnd * acked_segments, target);
+    } else {
+        cc->cwnd += 0.01 * acked_segments / cc->cwnd;  // Plateau: barely grow
+    }
+
+    // Never fall behind what Reno would have reached since the reduction
+    cs->w_est += 3 * (1 - CUBIC_BETA) / (1 + CUBIC_BETA) * acked_segments / cc->cwnd;
+    if (cs->w_est > cc->cwnd) {
+        cc->cwnd = cs->w_est;
+    }
+    VLOG(DEBUG, "CUBIC: CWND %.2f, target %.2f, W_max %.2f", cc->cwnd, target, cs->w_max);
+}
+
+// Remember where the loss happened, with fast convergence: a flow that lost
+// below its previous W_max releases bandwidth to newer flows
+static void cubic_reduce(cc_ctx *cc)
+{
+    cubic_state *cs = cc->priv;
+
+    if (cc->cwnd < cs->w_max) {
+        cs->w_max = cc->cwnd * (1 + CUBIC_BETA) / 2;
+    } else {
+        cs->w_max = cc->cwnd;
+    }
+    cs->epoch_start = 0;
+    cc->ssthresh = (int)fmax(cc->cwnd * CUBIC_BETA, 2);
+}
+
+static void cubic_on_loss(cc_ctx *cc, uint64_t now_us)
+{
+    cubic_reduce(cc);
+    cc->state = FAST_RETRANSMIT;
+}
+
+static void cubic_on_timeout(cc_ctx *cc, uint64_t now_us)
+{
+    cubic_reduce(cc);
+    cc->cwnd = 1.0;
+    cc->state = SLOW_START;
+}
+
+const cc_ops cubic_ops = {
+    .name = "cubic",
+    .init = cubic_init,
+    .release = cubic_release,
+    .on_ack = cubic_on_ack,
+    .on_loss = cubic_on_loss,
+    .on_timeout = cubic_on_timeout,
+};
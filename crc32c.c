@@ -0,0 +1,244 @@
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRC32C_X86 1
+#endif
+
+#include "crc32c.h"
+
+#define CRC32C_POLY 0x82f63b78   // reflected: bit 31 is x^0, bit 0 is x^31
+#define LANE_MIN    64           // below three lanes of this, one chain is as fast
+#define LANE_MAX    4096         // longer buffers go in rounds of three such lanes
+#define SHIFT_MAX   4096         // zero-byte shifts kept in shift_op[]
+
+static uint32_t crc_table[8][256];          // slicing-by-8: byte n followed by k zero bytes
+static uint32_t x2n[32];                    // x^(2^n) mod p
+static uint32_t shift_op[SHIFT_MAX + 1];    // x^(8n) mod p
+
+// a(x) * b(x) mod p, one bit of a at a time (zlib's multmodp)
+static uint32_t mul_bitwise(uint32_t a, uint32_t b)
+{
+    uint32_t m = (uint32_t)1 << 31;
+    uint32_t p = 0;
+
+    while (a != 0) {
+        if (a & m) {
+            p ^= b;
+            a ^= m;
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+// Raw (unconditioned) CRC register update, eight bytes per step
+static uint32_t update_table(uint32_t crc, const uint8_t *p, size_t len)
+{
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t w;
+
+        memcpy(&w, p, 8);
+        w ^= crc;
+        crc = crc_table[7][w & 0xff] ^ crc_table[6][w >> 8 & 0xff] ^
+              crc_table[5][w >> 16 & 0xff] ^ crc_table[4][w >> 24 & 0xff] ^
+              crc_table[3][w >> 32 & 0xff] ^ crc_table[2][w >> 40 & 0xff] ^
+              crc_table[1][w >> 48 & 0xff] ^ crc_table[0][w >> 56];
+    }
+    while (len-- > 0) {
+        crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static void batch_serial(const void *const *bufs, const size_t *lens, uint32_t *crcs, int n)
+{
+    for (int i = 0; i < n; i++) {
+        crcs[i] = crc32c(0, bufs[i], lens[i]);
+    }
+}
+
+static uint32_t (*update_kernel)(uint32_t crc, const uint8_t *p, size_t len) = update_table;
+static void (*batch_kernel)(const void *const *bufs, const size_t *lens, uint32_t *crcs, int n) = batch_serial;
+static uint32_t (*mul_kernel)(uint32_t a, uint32_t b) = mul_bitwise;
+static const char *kernel = "table";
+
+// x^(8 len) mod p
+static uint32_t shift_for(size_t len)
+{
+    uint32_t op = (uint32_t)1 << 31;
+
+    if (len <= SHIFT_MAX) {
+        return shift_op[len];
+    }
+    for (int k = 3; len != 0; len >>= 1, k++) {
+        if (len & 1) {
+            op = mul_kernel(x2n[k & 31], op);
+        }
+    }
+    return op;
+}
+
+#ifdef CRC32C_X86
+static inline uint64_t load64(const uint8_t *p)
+{
+    uint64_t w;
+
+    memcpy(&w, p, 8);
+    return w;
+}
+
+// The 63-bit carry-less product, shifted into the reflected order, is
+// hi + lo * x^32; the CRC32 instruction computes lo * x^32 mod p
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t mul_clmul(uint32_t a, uint32_t b)
+{
+    __m128i prod = _mm_clmulepi64_si128(_mm_cvtsi32_si128((int)a), _mm_cvtsi32_si128((int)b), 0);
+    uint64_t v = (uint64_t)_mm_cvtsi128_si64(prod) << 1;
+
+    return (uint32_t)_mm_crc32_u32(0, (uint32_t)v) ^ (uint32_t)(v >> 32);
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t update_chain(uint64_t crc, const uint8_t *p, size_t len)
+{
+    for (; len >= 8; p += 8, len -= 8) {
+        crc = _mm_crc32_u64(crc, load64(p));
+    }
+    while (len-- > 0) {
+        crc = _mm_crc32_u8((uint32_t)crc, *p++);
+    }
+    return (uint32_t)crc;
+}
+
+// Three lanes of a buffer side by side, then joined: lane 0 shifted over
+// lane 1 and the result over lane 2
+__attribute__((target("sse4.2")))
+static uint32_t update_sse42(uint32_t crc, const uint8_t *p, size_t len)
+{
+    while (len >= 3 * LANE_MIN) {
+        size_t lane = len / 3 & ~(size_t)7;
+        uint64_t c0 = crc, c1 = 0, c2 = 0;
+        uint32_t op;
+
+        if (lane > LANE_MAX) {
+            lane = LANE_MAX;
+        }
+        for (size_t i = 0; i < lane; i += 8) {
+            c0 = _mm_crc32_u64(c0, load64(p + i));
+            c1 = _mm_crc32_u64(c1, load64(p + lane + i));
+            c2 = _mm_crc32_u64(c2, load64(p + 2 * lane + i));
+        }
+        op = shift_op[lane];
+        crc = mul_kernel(op, mul_kernel(op, (uint32_t)c0) ^ (uint32_t)c1) ^ (uint32_t)c2;
+        p += 3 * lane;
+        len -= 3 * lane;
+    }
+    return update_chain(crc, p, len);
+}
+
+// Three buffers side by side over the length they share, each finished alone
+__attribute__((target("sse4.2")))
+static void batch_sse42(const void *const *bufs, const size_t *lens, uint32_t *crcs, int n)
+{
+    int i = 0;
+
+    for (; i + 3 <= n; i += 3) {
+        const uint8_t *a = bufs[i], *b = bufs[i + 1], *c = bufs[i + 2];
+        size_t common = lens[i];
+        uint64_t ca = 0xffffffff, cb = 0xffffffff, cc = 0xffffffff;
+
+        if (lens[i + 1] < common) {
+            common = lens[i + 1];
+        }
+        if (lens[i + 2] < common) {
+            common = lens[i + 2];
+        }
+        common &= ~(size_t)7;
+        for (size_t j = 0; j < common; j += 8) {
+            ca = _mm_crc32_u64(ca, load64(a + j));
+            cb = _mm_crc32_u64(cb, load64(b + j));
+            cc = _mm_crc32_u64(cc, load64(c + j));
+        }
+        crcs[i] = ~update_sse42(ca, a + common, lens[i] - common);
+        crcs[i + 1] = ~update_sse42(cb, b + common, lens[i + 1] - common);
+        crcs[i + 2] = ~update_sse42(cc, c + common, lens[i + 2] - common);
+    }
+    batch_serial(bufs + i, lens + i, crcs + i, n - i);
+}
+#endif
+
+int crc32c_use_kernel(const char *name)
+{
+    if (strcmp(name, "table") == 0) {
+        update_kernel = update_table;
+        batch_kernel = batch_serial;
+        mul_kernel = mul_bitwise;
+#ifdef CRC32C_X86
+    } else if (strcmp(name, "sse42") == 0 && __builtin_cpu_supports("sse4.2")) {
+        update_kernel = update_sse42;
+        batch_kernel = batch_sse42;
+        mul_kernel = mul_bitwise;
+    } else if (strcmp(name, "pclmul") == 0 && __builtin_cpu_supports("sse4.2") &&
+               __builtin_cpu_supports("pclmul")) {
+        update_kernel = update_sse42;
+        batch_kernel = batch_sse42;
+        mul_kernel = mul_clmul;
+#endif
+    } else {
+        return -1;
+    }
+    kernel = name;
+    return 0;
+}
+
+const char *crc32c_kernel_name(void)
+{
+    return kernel;
+}
+
+void crc32c_init(void)
+{
+    for (int n = 0; n < 256; n++) {
+        uint32_t crc = n;
+
+        for (int k = 0; k < 8; k++) {
+            crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+        }
+        crc_table[0][n] = crc;
+    }
+    for (int n = 0; n < 256; n++) {
+        for (int k = 1; k < 8; k++) {
+            crc_table[k][n] = (crc_table[k - 1][n] >> 8) ^ crc_table[0][crc_table[k - 1][n] & 0xff];
+        }
+    }
+
+    x2n[0] = (uint32_t)1 << 30;   // x^1
+    for (int n = 1; n < 32; n++) {
+        x2n[n] = mul_bitwise(x2n[n - 1], x2n[n - 1]);
+    }
+    shift_op[0] = (uint32_t)1 << 31;
+    for (int n = 1; n <= SHIFT_MAX; n++) {
+        shift_op[n] = mul_bitwise(shift_op[n - 1], x2n[3]);
+    }
+
+    if (crc32c_use_kernel("pclmul") < 0 && crc32c_use_kernel("sse42") < 0) {
+        crc32c_use_kernel("table");
+    }
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len)
+{
+    return ~update_kernel(~crc, buf, len);
+}
+
+void crc32c_batch(const void *const *bufs, const size_t *lens, uint32_t *crcs, int n)
+{
+    batch_kernel(bufs, lens, crcs, n);
+}
+
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2)
+{
+    return mul_kernel(shift_for(len2), crc1) ^ crc2;
+}
@@ -0,0 +1,35 @@
+#ifndef CRC32C_H_INCLUDED
+#define CRC32C_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CRC32C (Castagnoli, reflected polynomial 0x82f63b78), the checksum the
+ * SSE4.2 CRC32 instruction computes. Values are finished CRCs, as in zlib:
+ * crc32c(0, buf, len) is the CRC of buf, and passing it back in extends it
+ * over the next buffer.
+ *
+ * One CRC32 instruction takes 8 bytes but has a latency of 3 cycles, so a
+ * single dependency chain runs at a third of the instruction's throughput.
+ * crc32c splits a long buffer into three lanes and runs their chains side
+ * by side; crc32c_batch does the same with three buffers at a time.
+ * Joining lane CRCs, and crc32c_combine, shift a CRC over n zero bytes: a
+ * multiplication by x^(8n) modulo the polynomial, done with one PCLMULQDQ
+ * and one CRC32 where the CPU has them. The fallback is slicing-by-8
+ * tables, one dependency chain.
+ */
+
+void crc32c_init(void);                  // builds the tables; call once before any other crc32c function
+int crc32c_use_kernel(const char *name); // "pclmul", "sse42" or "table"; -1 if the CPU lacks it
+const char *crc32c_kernel_name(void);
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+// crcs[i] = crc32c(0, bufs[i], lens[i]) for n buffers, interleaved
+void crc32c_batch(const void *const *bufs, const size_t *lens, uint32_t *crcs, int n);
+
+// The CRC of A followed by B, from crc1 = CRC(A), crc2 = CRC(B) and len2 = |B|
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2);
+
+#endif
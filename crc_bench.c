@@ -0,0 +1,147 @@
+/*
+ * crc_bench: CRC32C cost on one core for each kernel the CPU has. A
+ * segment is what the sender checksums per new segment, a batch what the
+ * receiver verifies per recvmmsg call, and combine is the per-segment step
+ * of the whole-file CRC. Every kernel is first checked against the table
+ * one, and crc32c_combine against CRCs of concatenations.
+ *
+ * usage: crc_bench [rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "packet.h"
+#include "batch.h"
+#include "crc32c.h"
+
+#define BENCH_BUF (64 * 1024)
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static uint8_t data[BENCH_BUF];
+static volatile uint32_t sink;  // keeps the results live
+
+// Results of the current kernel that differ from the table kernel's
+static int check_kernel(const char *name)
+{
+    const void *bufs[BATCH_MAX];
+    size_t lens[BATCH_MAX];
+    uint32_t got[BATCH_MAX];
+    uint32_t want[BENCH_BUF / 64 + 1];
+    int bad = 0;
+
+    crc32c_use_kernel("table");
+    for (int i = 0; i <= BENCH_BUF / 64; i++) {
+        want[i] = crc32c(0, data + i * 7 % 64, i * 64);
+    }
+    crc32c_use_kernel(name);
+    if (crc32c(0, "123456789", 9) != 0xe3069283) {
+        bad++;
+    }
+    for (int i = 0; i <= BENCH_BUF / 64; i++) {
+        bad += crc32c(0, data + i * 7 % 64, i * 64) != want[i];
+    }
+    for (size_t len = 0; len < 3 * DATA_SIZE; len += 97) {
+        uint32_t a = crc32c(0, data, len);
+        uint32_t b = crc32c(0, data + len, BENCH_BUF / 2);
+
+        bad += crc32c_combine(a, b, BENCH_BUF / 2) != crc32c(0, data, len + BENCH_BUF / 2);
+        bad += crc32c(a, data + len, BENCH_BUF / 2) != crc32c(0, data, len + BENCH_BUF / 2);
+    }
+    for (int i = 0; i < BATCH_MAX; i++) {
+        bufs[i] = data + i * 101;
+        lens[i] = DATA_SIZE - i * 13 % 200;
+    }
+    crc32c_batch(bufs, lens, got, BATCH_MAX);
+    for (int i = 0; i < BATCH_MAX; i++) {
+        bad += got[i] != crc32c(0, bufs[i], lens[i]);
+    }
+    return bad;
+}
+
+// GB/s checksumming len-byte buffers one at a time
+static double bench_single(long rounds, size_t len)
+{
+    long n = rounds * (BENCH_BUF / len);
+    uint32_t crc = 0;
+    double start = now_ns();
+
+    for (long i = 0; i < n; i++) {
+        crc ^= crc32c(0, data + (size_t)(i % (BENCH_BUF / len)) * len, len);
+    }
+    sink = crc;
+    return (double)n * len / (now_ns() - start);
+}
+
+// GB/s checksumming batches of BATCH_MAX full segments
+static double bench_batch(long rounds)
+{
+    const void *bufs[BATCH_MAX];
+    size_t lens[BATCH_MAX];
+    uint32_t crcs[BATCH_MAX];
+    long n = rounds * (BENCH_BUF / ((long)DATA_SIZE * BATCH_MAX) + 1);
+    double start;
+
+    for (int i = 0; i < BATCH_MAX; i++) {
+        bufs[i] = data + (size_t)i * 1000 % (BENCH_BUF - DATA_SIZE);
+        lens[i] = DATA_SIZE;
+    }
+    start = now_ns();
+    for (long i = 0; i < n; i++) {
+        crc32c_batch(bufs, lens, crcs, BATCH_MAX);
+        sink = crcs[i % BATCH_MAX];
+    }
+    return (double)n * BATCH_MAX * DATA_SIZE / (now_ns() - start);
+}
+
+// ns per crc32c_combine of a segment onto a running CRC
+static double bench_combine(long rounds)
+{
+    long n = rounds * 100;
+    uint32_t crc = 1;
+    double start = now_ns();
+
+    for (long i = 0; i < n; i++) {
+        crc = crc32c_combine(crc, (uint32_t)i, DATA_SIZE);
+    }
+    sink = crc;
+    return (now_ns() - start) / n;
+}
+
+int main(int argc, char **argv)
+{
+    static const char *kernels[] = {"table", "sse42", "pclmul"};
+    long rounds = argc > 1 ? atol(argv[1]) : 2000;
+    int failed = 0;
+
+    crc32c_init();
+    srand(1);
+    for (int i = 0; i < BENCH_BUF; i++) {
+        data[i] = rand();
+    }
+
+    printf("CRC32C on one core, GB/s; combine in ns per segment\n");
+    printf("%-8s %10s %10s %10s %10s\n", "kernel", "segment", "64 KB", "batch", "combine");
+    for (unsigned int i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (crc32c_use_kernel(kernels[i]) < 0) {
+            printf("%-8s (not supported by this CPU)\n", kernels[i]);
+            continue;
+        }
+        if (check_kernel(kernels[i]) != 0) {
+            printf("%-8s WRONG\n", kernels[i]);
+            failed = 1;
+            continue;
+        }
+        printf("%-8s %10.2f %10.2f %10.2f %10.1f\n", kernels[i],
+               bench_single(rounds, DATA_SIZE), bench_single(rounds / 20 + 1, BENCH_BUF),
+               bench_batch(rounds), bench_combine(rounds));
+    }
+    return failed;
+}
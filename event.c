@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#include "common.h"
+#include "event.h"
+
+#define EV_MAX_EVENTS 64
+
+uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void ev_init(event_loop *loop)
+{
+    struct epoll_event ev;
+
+    memset(loop, 0, sizeof(*loop));
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0)
+        error("epoll_create1");
+
+    loop->timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (loop->timerfd < 0)
+        error("timerfd_create");
+
+    // The timerfd is registered with a NULL pointer so ev_run can tell it apart from ev_io entries
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->timerfd, &ev) < 0)
+        error("epoll_ctl timerfd");
+
+    loop->heap_cap = 16;
+    loop->heap = malloc(loop->heap_cap * sizeof(ev_timer *));
+    if (loop->heap == NULL)
+        error("malloc");
+}
+
+void ev_close(event_loop *loop)
+{
+    close(loop->timerfd);
+    close(loop->epfd);
+    free(loop->heap);
+    loop->heap = NULL;
+}
+
+void ev_add_io(event_loop *loop, ev_io *io, int fd, uint32_t events, ev_io_cb cb, void *arg)
+{
+    struct epoll_event ev;
+
+    io->fd = fd;
+    io->cb = cb;
+    io->arg = arg;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = io;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        error("epoll_ctl");
+}
+
+/*
+ * Program the timerfd for the earliest deadline. The timerfd is only moved
+ * earlier here; if the earliest timer was pushed back (the common RTO restart
+ * on every ACK) the stale expiry fires, finds nothing due and re-arms then.
+ * That keeps timer restarts free of syscalls.
+ */
+static void program_timerfd(event_loop *loop, int force)
+{
+    struct itimerspec its;
+    uint64_t deadline;
+
+    if (loop->heap_len == 0) {
+        return;
+    }
+    deadline = loop->heap[0]->heap_ns;
+    if (!force && loop->armed_ns != 0 && loop->armed_ns <= deadline) {
+        return;
+    }
+
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = deadline / 1000000000;
+    its.it_value.tv_nsec = deadline % 1000000000;
+    if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+        its.it_value.tv_nsec = 1;  // an all-zero value would disarm the timerfd
+    }
+    loop->syscalls++;
+    if (timerfd_settime(loop->timerfd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+        error("timerfd_settime");
+    loop->armed_ns = deadline;
+}
+
+static void heap_swap(event_loop *loop, int a, int b)
+{
+    ev_timer *t = loop->heap[a];
+    loop->heap[a] = loop->heap[b];
+    loop->heap[b] = t;
+    loop->heap[a]->heap_idx = a;
+    loop->heap[b]->heap_idx = b;
+}
+
+static void heap_up(event_loop *loop, int i)
+{
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (loop->heap[parent]->heap_ns <= loop->heap[i]->heap_ns)
+            break;
+        heap_swap(loop, i, parent);
+        i = parent;
+    }
+}
+
+static void heap_down(event_loop *loop, int i)
+{
+    while (1) {
+        int left = 2 * i + 1;
+        int right = left + 1;
+        int smallest = i;
+
+        if (left < loop->heap_len && loop->heap[left]->heap_ns < loop->heap[smallest]->heap_ns)
+            smallest = left;
+        if (right < loop->heap_len && loop->heap[right]->heap_ns < loop->heap[smallest]->heap_ns)
+            smallest = right;
+        if (smallest == i)
+            break;
+        heap_swap(loop, i, smallest);
+        i = smallest;
+    }
+}
+
+void ev_timer_init(ev_timer *t, ev_timer_cb cb, void *arg)
+{
+    t->deadline_ns = 0;
+    t->heap_ns = 0;
+    t->cb = cb;
+    t->arg = arg;
+    t->heap_idx = -1;
+}
+
+int ev_timer_pending(ev_timer *t)
+{
+    return t->heap_idx >= 0;
+}
+
+void ev_timer_stop(event_loop *loop, ev_timer *t)
+{
+    int i = t->heap_idx;
+
+    if (i < 0) {
+        return;
+    }
+    loop->heap_len--;
+    if (i != loop->heap_len) {
+        heap_swap(loop, i, loop->heap_len);
+        heap_up(loop, i);
+        heap_down(loop, i);
+    }
+    t->heap_idx = -1;
+}
+
+void ev_timer_start_at_ns(event_loop *loop, ev_timer *t, uint64_t deadline_ns)
+{
+    t->deadline_ns = deadline_ns;
+    if (t->heap_idx >= 0) {
+        if (deadline_ns >= t->heap_ns) {
+            // Pushed back: run_timers re-files it when its current key comes due
+            return;
+        }
+        // Brought forward: move it up the heap
+        t->heap_ns = deadline_ns;
+        heap_up(loop, t->heap_idx);
+    } else {
+        if (loop->heap_len == loop->heap_cap) {
+            ev_timer **heap = realloc(loop->heap, loop->heap_cap * 2 * sizeof(ev_timer *));
+
+            if (heap == NULL) {
+                error("realloc");
+            }
+            loop->heap = heap;
+            loop->heap_cap *= 2;
+        }
+        t->heap_ns = deadline_ns;
+        t->heap_idx = loop->heap_len;
+        loop->heap[loop->heap_len++] = t;
+        heap_up(loop, t->heap_idx);
+    }
+    program_timerfd(loop, 0);
+}
+
+void ev_timer_start_at(event_loop *loop, ev_timer *t, uint64_t deadline_us)
+{
+    ev_timer_start_at_ns(loop, t, deadline_us * 1000);
+}
+
+void ev_timer_start(event_loop *loop, ev_timer *t, uint64_t delay_us)
+{
+    ev_timer_start_at_ns(loop, t, now_ns() + delay_us * 1000);
+}
+
+// Fire every timer whose deadline has passed, then re-arm for the next one
+static void run_timers(event_loop *loop)
+{
+    uint64_t expirations;
+    uint64_t now = now_ns();
+
+    // Drain the expiry counter; EAGAIN just means the timerfd was re-armed meanwhile
+    loop->syscalls++;
+    if (read(loop->timerfd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+        error("read timerfd");
+    loop->armed_ns = 0;
+
+    while (loop->heap_len > 0 && loop->heap[0]->heap_ns <= now && !loop->stop) {
+        ev_timer *t = loop->heap[0];
+        if (t->deadline_ns > now) {
+            // Pushed back since it was filed: re-file it at its real deadline
+            t->heap_ns = t->deadline_ns;
+            heap_down(loop, 0);
+            continue;
+        }
+        ev_timer_stop(loop, t);
+        t->cb(t, t->arg);
+    }
+    program_timerfd(loop, 1);
+}
+
+void ev_run(event_loop *loop)
+{
+    struct epoll_event events[EV_MAX_EVENTS];
+
+    while (!loop->stop) {
+        int n = epoll_wait(loop->epfd, events, EV_MAX_EVENTS, -1);
+        loop->syscalls++;
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            error("epoll_wait");
+        }
+
+        for (int i = 0; i < n && !loop->stop; i++) {
+            ev_io *io = events[i].data.ptr;
+            if (io == NULL) {
+                run_timers(loop);
+            } else {
+                io->cb(io->fd, events[i].events, io->arg);
+            }
+        }
+    }
+}
+
+void ev_stop(event_loop *loop)
+{
+    loop->stop = 1;
+}
@@ -0,0 +1,64 @@
+#ifndef EVENT_H_INCLUDED
+#define EVENT_H_INCLUDED
+
+#include <stdint.h>
+
+/*
+ * Single-threaded event loop: epoll for socket readiness plus one timerfd
+ * that is always programmed to the earliest pending ev_timer deadline.
+ * Timers live in a binary min-heap, so start/stop are O(log n) and any
+ * number of them (RTO, pacing, ...) share the one timerfd. Pushing an armed
+ * timer back leaves it in place: it is re-filed when its old slot comes due,
+ * so the RTO restart on every ACK costs O(1) however many connections share
+ * the loop. Deadlines are absolute CLOCK_MONOTONIC times, kept in
+ * nanoseconds so a pacer can schedule sub-microsecond gaps; the _at variants
+ * take microseconds or nanoseconds.
+ */
+
+struct ev_timer;
+typedef void (*ev_timer_cb)(struct ev_timer *t, void *arg);
+typedef void (*ev_io_cb)(int fd, uint32_t events, void *arg);
+
+typedef struct ev_timer {
+    uint64_t deadline_ns;   // when the timer fires
+    uint64_t heap_ns;       // its key in the heap, at or before deadline_ns
+    ev_timer_cb cb;
+    void *arg;
+    int heap_idx;           // position in the loop's heap, -1 when not armed
+} ev_timer;
+
+typedef struct {
+    int fd;
+    ev_io_cb cb;
+    void *arg;
+} ev_io;
+
+typedef struct {
+    int epfd;
+    int timerfd;
+    ev_timer **heap;        // min-heap ordered by deadline_ns
+    int heap_len;
+    int heap_cap;
+    uint64_t armed_ns;      // deadline currently programmed into timerfd (0 = disarmed)
+    int stop;               // ev_run returns once this is set
+    unsigned long syscalls; // epoll_wait, timerfd reads and timerfd_settime calls issued
+} event_loop;
+
+uint64_t now_us(void);                                  // CLOCK_MONOTONIC in microseconds
+uint64_t now_ns(void);                                  // CLOCK_MONOTONIC in nanoseconds
+
+void ev_init(event_loop *loop);
+void ev_close(event_loop *loop);
+void ev_add_io(event_loop *loop, ev_io *io, int fd, uint32_t events, ev_io_cb cb, void *arg);
+
+void ev_timer_init(ev_timer *t, ev_timer_cb cb, void *arg);
+void ev_timer_start(event_loop *loop, ev_timer *t, uint64_t delay_us);   // (re)arms delay_us from now
+void ev_timer_start_at(event_loop *loop, ev_timer *t, uint64_t deadline_us);
+void ev_timer_start_at_ns(event_loop *loop, ev_timer *t, uint64_t deadline_ns);
+void ev_timer_stop(event_loop *loop, ev_timer *t);
+int ev_timer_pending(ev_timer *t);
+
+void ev_run(event_loop *loop);                          // dispatches events until ev_stop
+void ev_stop(event_loop *loop);
+
+#endif
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "evlog.h"
+
+// Write all of buf, or fail
+static int write_all(int fd, const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * The writer thread: hands whatever the producer has published to the file,
+ * at most up to the end of the ring (or EVLOG_CHUNK records) per write(),
+ * then frees the space. With nothing to write it sleeps EVLOG_IDLE_US; it
+ * never reads a clock, so it works under rdt_sim's virtual one too.
+ */
+static void *writer_main(void *arg)
+{
+    evlog *l = arg;
+    struct timespec idle = {0, EVLOG_IDLE_US * 1000};
+
+    while (1) {
+        uint64_t tail = l->tail;
+        uint64_t head = __atomic_load_n(&l->head, __ATOMIC_ACQUIRE);
+        uint64_t idx = tail & (EVLOG_RING - 1);
+        uint64_t n = head - tail;
+
+        if (n == 0) {
+            // Stopping is set after the last put, so a head read after it is final
+            if (__atomic_load_n(&l->stopping, __ATOMIC_ACQUIRE)) {
+                if (__atomic_load_n(&l->head, __ATOMIC_ACQUIRE) == tail) {
+                    break;
+                }
+                continue;
+            }
+            nanosleep(&idle, NULL);
+            continue;
+        }
+        if (n > EVLOG_RING - idx) {
+            n = EVLOG_RING - idx;
+        }
+        if (n > EVLOG_CHUNK) {
+            n = EVLOG_CHUNK;
+        }
+        if (!l->failed) {
+            if (write_all(l->fd, (const char *)&l->ring[idx], n * sizeof(evlog_record)) < 0) {
+                VLOG(WARNING, "event log write failed: %s", strerror(errno));
+                l->failed = 1;
+            }
+            l->writes++;
+        }
+        __atomic_store_n(&l->tail, tail + n, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+int evlog_open(evlog *l, const char *path)
+{
+    evlog_file_header hdr;
+
+    memset(l, 0, sizeof(*l));
+    l->ring = malloc(EVLOG_RING * sizeof(evlog_record));
+    if (l->ring == NULL) {
+        error("malloc");
+    }
+    l->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (l->fd < 0) {
+        free(l->ring);
+        return -1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, EVLOG_MAGIC, sizeof(hdr.magic));
+    hdr.version = EVLOG_VERSION;
+    hdr.record_size = sizeof(evlog_record);
+    if (write_all(l->fd, (const char *)&hdr, sizeof(hdr)) < 0 ||
+        pthread_create(&l->writer, NULL, writer_main, l) != 0) {
+        close(l->fd);
+        free(l->ring);
+        return -1;
+    }
+    return 0;
+}
+
+void evlog_put(evlog *l, const evlog_record *r)
+{
+    uint64_t head = l->head;
+
+    // The writer's tail is only read again when the cached one says full
+    if (head - l->cached_tail == EVLOG_RING) {
+        l->cached_tail = __atomic_load_n(&l->tail, __ATOMIC_ACQUIRE);
+        if (head - l->cached_tail == EVLOG_RING) {
+            l->stalls++;
+            do {
+                sched_yield();
+                l->cached_tail = __atomic_load_n(&l->tail, __ATOMIC_ACQUIRE);
+            } while (head - l->cached_tail == EVLOG_RING);
+        }
+    }
+    l->ring[head & (EVLOG_RING - 1)] = *r;
+    __atomic_store_n(&l->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void evlog_close(evlog *l)
+{
+    __atomic_store_n(&l->stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(l->writer, NULL);
+    if (l->stalls > 0) {
+        VLOG(WARNING, "event log: producer waited for the writer %lu times", l->stalls);
+    }
+    close(l->fd);
+    free(l->ring);
+    l->ring = NULL;
+}
@@ -0,0 +1,69 @@
+#ifndef EVLOG_H_INCLUDED
+#define EVLOG_H_INCLUDED
+
+#include <stdint.h>
+#include <pthread.h>
+
+#define EVLOG_MAGIC      "RDTEVLOG"
+#define EVLOG_VERSION    1
+#define EVLOG_RING       (1 << 16)   // records buffered between the producer and the writer
+#define EVLOG_CHUNK      4096        // most records handed to one write()
+#define EVLOG_IDLE_US    5000        // writer's sleep when the ring is empty
+
+/*
+ * Binary event log: tracing off the hot path.
+ *
+ * The producer copies fixed-size records into a single-producer,
+ * single-consumer ring; a background writer thread drains it to the file
+ * in large write()s. Logging an event is a 32-byte store and one release
+ * store of the head index: no locks, no syscalls, no formatting.
+ *
+ * Only one thread may log to a given evlog. When the ring is full the
+ * producer yields until the writer makes room (counted in stalls), so no
+ * record is ever dropped.
+ *
+ * The file is a header (magic, version, record size) followed by the raw
+ * records in host byte order. evlog.py turns it back into the CSV files
+ * plot.py reads.
+ */
+enum evlog_type {
+    EVLOG_CWND = 1,     // sender: time = us since start, value = cwnd, arg = ssthresh
+    EVLOG_RECV = 2,     // receiver: time = wall-clock us, value = data bytes, arg = seqno
+};
+
+typedef struct {
+    uint32_t type;      // EVLOG_*
+    int32_t conn_id;
+    int64_t time;       // on the clock the type names
+    int64_t arg;
+    double value;
+} evlog_record;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+} evlog_file_header;
+
+typedef struct {
+    // Producer's cache line
+    uint64_t head __attribute__((aligned(64)));    // next record to fill
+    uint64_t cached_tail;                          // the writer's tail, as last seen
+    unsigned long stalls;                          // puts that found the ring full
+
+    // Writer's cache line
+    uint64_t tail __attribute__((aligned(64)));    // next record to write out
+    int stopping;
+    int failed;                                    // a write failed; the rest is discarded
+    unsigned long writes;                          // write() calls issued
+
+    evlog_record *ring;
+    int fd;
+    pthread_t writer;
+} evlog;
+
+int evlog_open(evlog *l, const char *path);    // creates path and starts the writer; -1 on failure
+void evlog_put(evlog *l, const evlog_record *r);
+void evlog_close(evlog *l);                    // writes out everything logged, stops the writer
+
+#endif
@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""
+Convert the binary event logs of rdt_sender (CWND.evlog) and rdt_receiver
+(throughput_data.evlog) into the text files plot.py reads: CWND.csv and
+throughput_data.txt, written next to each log unless --dir says otherwise.
+
+The record layout must match evlog.h.
+"""
+import os
+import struct
+import sys
+from argparse import ArgumentParser
+
+MAGIC = b"RDTEVLOG"
+VERSION = 1
+HEADER = struct.Struct("=8sII")       # evlog_file_header
+RECORD = struct.Struct("=Iiqqd")      # evlog_record: type, conn_id, time, arg, value
+
+EVLOG_CWND = 1
+EVLOG_RECV = 2
+
+OUTPUTS = {
+    # type: (file name, CSV header, line format)
+    EVLOG_CWND: ("CWND.csv", "time,cwnd\n",
+                 lambda t, arg, value: "%d,%f\n" % (t // 1000, value)),
+    EVLOG_RECV: ("throughput_data.txt", "epoch time, bytes received, sequence number\n",
+                 lambda t, arg, value: "%d,%d,%d\n" % (t // 1000000, value, arg)),
+}
+
+
+def convert(path, outdir):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if len(data) < HEADER.size:
+        sys.exit("%s: not an event log" % path)
+    magic, version, record_size = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION or record_size != RECORD.size:
+        sys.exit("%s: not a version %d event log with %d-byte records" % (path, VERSION, RECORD.size))
+    body = data[HEADER.size:]
+    body = body[:len(body) - len(body) % RECORD.size]  # a torn last record is dropped
+
+    files = {}
+    try:
+        for rtype, conn_id, t, arg, value in RECORD.iter_unpack(body):
+            if rtype not in OUTPUTS:
+                continue
+            name, header, line = OUTPUTS[rtype]
+            if rtype not in files:
+                files[rtype] = open(os.path.join(outdir, name), 'w')
+                files[rtype].write(header)
+            files[rtype].write(line(t, arg, value))
+    finally:
+        for f in files.values():
+            f.close()
+    return [OUTPUTS[t][0] for t in files]
+
+
+parser = ArgumentParser(description="event log to CSV")
+parser.add_argument('logs', nargs='+', help="CWND.evlog and/or throughput_data.evlog")
+parser.add_argument('--dir', '-d', help="directory for the CSV files (default: the log's own)")
+args = parser.parse_args()
+
+for path in args.logs:
+    outdir = args.dir if args.dir is not None else (os.path.dirname(path) or '.')
+    written = convert(path, outdir)
+    print("%s: wrote %s" % (path, ", ".join(written) if written else "nothing"))
@@ -0,0 +1,304 @@
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FEC_X86 1
+#endif
+
+#include "fec.h"
+
+#define GF_POLY 0x11d   // x^8 + x^4 + x^3 + x^2 + 1; 2 generates the field
+
+static uint8_t gf_exp[510];
+static uint8_t gf_log[256];
+static uint8_t gf_mul[256][256];            // full product table, for the scalar kernel
+static uint8_t gf_nibble[256][2][16];       // c * x and c * (x << 4) for x < 16, for PSHUFB
+static uint8_t coef[FEC_MAX_PARITY][FEC_MAX_DATA];
+
+static uint8_t gf_div(uint8_t a, uint8_t b)
+{
+    if (a == 0) {
+        return 0;
+    }
+    return gf_exp[gf_log[a] + 255 - gf_log[b]];
+}
+
+static uint8_t gf_inv(uint8_t a)
+{
+    return gf_exp[255 - gf_log[a]];
+}
+
+static void xor_scalar(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        uint64_t a, b;
+
+        memcpy(&a, dst + i, 8);
+        memcpy(&b, src + i, 8);
+        a ^= b;
+        memcpy(dst + i, &a, 8);
+    }
+    for (; i < len; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+static void muladd_scalar(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+    const uint8_t *t = gf_mul[c];
+
+    for (size_t i = 0; i < len; i++) {
+        dst[i] ^= t[src[i]];
+    }
+}
+
+#ifdef FEC_X86
+__attribute__((target("ssse3")))
+static void xor_ssse3(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, s));
+    }
+    xor_scalar(dst + i, src + i, len - i);
+}
+
+// Each byte's low and high nibble index a 16-entry product table; the two
+// partial products XOR to the full one
+__attribute__((target("ssse3")))
+static void muladd_ssse3(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+    __m128i lo = _mm_loadu_si128((const __m128i *)gf_nibble[c][0]);
+    __m128i hi = _mm_loadu_si128((const __m128i *)gf_nibble[c][1]);
+    __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i p = _mm_xor_si128(_mm_shuffle_epi8(lo, _mm_and_si128(s, mask)),
+                                  _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask)));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, p));
+    }
+    muladd_scalar(dst + i, src + i, c, len - i);
+}
+
+__attribute__((target("avx2")))
+static void xor_avx2(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d, s));
+    }
+    xor_scalar(dst + i, src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static void muladd_avx2(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+    __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)gf_nibble[c][0]));
+    __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)gf_nibble[c][1]));
+    __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i p = _mm256_xor_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(s, mask)),
+                                     _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask)));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d, p));
+    }
+    muladd_scalar(dst + i, src + i, c, len - i);
+}
+#endif
+
+static void (*xor_kernel)(uint8_t *dst, const uint8_t *src, size_t len) = xor_scalar;
+static void (*muladd_kernel)(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len) = muladd_scalar;
+static const char *kernel = "scalar";
+
+int fec_use_kernel(const char *name)
+{
+    if (strcmp(name, "scalar") == 0) {
+        xor_kernel = xor_scalar;
+        muladd_kernel = muladd_scalar;
+#ifdef FEC_X86
+    } else if (strcmp(name, "ssse3") == 0 && __builtin_cpu_supports("ssse3")) {
+        xor_kernel = xor_ssse3;
+        muladd_kernel = muladd_ssse3;
+    } else if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        xor_kernel = xor_avx2;
+        muladd_kernel = muladd_avx2;
+#endif
+    } else {
+        return -1;
+    }
+    kernel = name;
+    return 0;
+}
+
+const char *fec_kernel_name(void)
+{
+    return kernel;
+}
+
+void fec_init(void)
+{
+    int x = 1;
+
+    for (int i = 0; i < 255; i++) {
+        gf_exp[i] = gf_exp[i + 255] = x;
+        gf_log[x] = i;
+        x <<= 1;
+        if (x & 0x100) {
+            x ^= GF_POLY;
+        }
+    }
+    for (int a = 1; a < 256; a++) {
+        for (int b = 1; b < 256; b++) {
+            gf_mul[a][b] = gf_exp[gf_log[a] + gf_log[b]];
+        }
+    }
+    for (int c = 0; c < 256; c++) {
+        for (int x = 0; x < 16; x++) {
+            gf_nibble[c][0][x] = gf_mul[c][x];
+            gf_nibble[c][1][x] = gf_mul[c][x << 4];
+        }
+    }
+
+    // Cauchy matrix 1 / (x_i + y_j) with x_i = i and y_j = FEC_MAX_DATA + j
+    // (disjoint sets), column j scaled by x_0 + y_j = y_j to make row 0 ones
+    for (int i = 0; i < FEC_MAX_PARITY; i++) {
+        for (int j = 0; j < FEC_MAX_DATA; j++) {
+            uint8_t y = FEC_MAX_DATA + j;
+
+            coef[i][j] = gf_div(y, i ^ y);
+        }
+    }
+
+    if (fec_use_kernel("avx2") < 0 && fec_use_kernel("ssse3") < 0) {
+        fec_use_kernel("scalar");
+    }
+}
+
+uint8_t fec_coef(int row, int col)
+{
+    return coef[row][col];
+}
+
+void fec_muladd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+    if (c == 1) {
+        xor_kernel(dst, src, len);
+    } else if (c != 0) {
+        muladd_kernel(dst, src, c, len);
+    }
+}
+
+void fec_encode(uint8_t *rows, size_t stride, int k, int col, const void *data, size_t len)
+{
+    for (int r = 0; r < k; r++) {
+        fec_muladd(rows + r * stride, data, coef[r][col], len);
+    }
+}
+
+int fec_recover(uint8_t *const *syn, const int *rows, const int *cols, int e,
+                uint8_t *const *out, size_t len)
+{
+    uint8_t m[FEC_MAX_PARITY][FEC_MAX_PARITY];
+    uint8_t inv[FEC_MAX_PARITY][FEC_MAX_PARITY];
+
+    if (e > FEC_MAX_PARITY) {
+        return -1;
+    }
+    for (int r = 0; r < e; r++) {
+        for (int c = 0; c < e; c++) {
+            m[r][c] = coef[rows[r]][cols[c]];
+            inv[r][c] = r == c;
+        }
+    }
+
+    // Gauss-Jordan elimination; the e x e systems are tiny next to the payload
+    for (int p = 0; p < e; p++) {
+        int pivot = p;
+        uint8_t scale;
+
+        while (pivot < e && m[pivot][p] == 0) {
+            pivot++;
+        }
+        if (pivot == e) {
+            return -1;
+        }
+        if (pivot != p) {
+            for (int c = 0; c < e; c++) {
+                uint8_t t = m[p][c];
+                m[p][c] = m[pivot][c];
+                m[pivot][c] = t;
+                t = inv[p][c];
+                inv[p][c] = inv[pivot][c];
+                inv[pivot][c] = t;
+            }
+        }
+        scale = gf_inv(m[p][p]);
+        for (int c = 0; c < e; c++) {
+            m[p][c] = gf_mul[scale][m[p][c]];
+            inv[p][c] = gf_mul[scale][inv[p][c]];
+        }
+        for (int r = 0; r < e; r++) {
+            uint8_t f = m[r][p];
+
+            if (r == p || f == 0) {
+                continue;
+            }
+            for (int c = 0; c < e; c++) {
+                m[r][c] ^= gf_mul[f][m[p][c]];
+                inv[r][c] ^= gf_mul[f][inv[p][c]];
+            }
+        }
+    }
+
+    for (int c = 0; c < e; c++) {
+        memset(out[c], 0, len);
+        for (int r = 0; r < e; r++) {
+            fec_muladd(out[c], syn[r], inv[c][r], len);
+        }
+    }
+    return 0;
+}
+
+int fec_parity_for(double loss, int n, int max_k)
+{
+    if (loss <= 0) {
+        return 0;
+    }
+    if (loss >= 1) {
+        return max_k;
+    }
+    for (int k = 0; k < max_k; k++) {
+        // P(at most k of the n + k segments lost), binomial
+        int m = n + k;
+        double pmf = pow(1 - loss, m);
+        double cdf = pmf;
+
+        for (int i = 0; i < k; i++) {
+            pmf *= (double)(m - i) / (i + 1) * loss / (1 - loss);
+            cdf += pmf;
+        }
+        if (1 - cdf < FEC_RESIDUAL) {
+            return k;
+        }
+    }
+    return max_k;
+}
@@ -0,0 +1,58 @@
+#ifndef FEC_H_INCLUDED
+#define FEC_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FEC_MAX_DATA    128     // data segments per block
+#define FEC_MAX_PARITY  16      // parity segments per block
+#define FEC_RESIDUAL    0.01    // block failure probability fec_parity_for aims below
+
+/*
+ * Forward error correction over GF(2^8): a systematic Reed-Solomon code
+ * built from a Cauchy matrix.
+ *
+ * A block is n data segments D_0..D_{n-1}, shorter ones padded with zeros,
+ * and parity row i (i < k) is the sum of fec_coef(i, j) * D_j. Every square
+ * submatrix of a Cauchy matrix is invertible, so any n of the n + k
+ * segments give back the rest. Its columns are scaled so that row 0 is all
+ * ones: the first parity segment is the plain XOR of the block, and a code
+ * with k = 1 costs no multiplications at all.
+ *
+ * Addition is XOR, so a receiver can fold every data segment it gets into
+ * the parity rows (fec_encode, the same call the sender makes) as it
+ * arrives. Once the parity segments are XORed in too, what is left of row
+ * i is the sum over the missing segments only, and fec_recover solves
+ * those equations.
+ *
+ * fec_muladd is the only loop over payload bytes. It multiplies 16 (SSSE3)
+ * or 32 (AVX2) bytes at a time by looking their two nibbles up in 16-entry
+ * product tables with PSHUFB; without those it uses a 64 KB product table.
+ * fec_init picks the widest the CPU has.
+ */
+
+void fec_init(void);                     // builds the tables; call once before any other fec_ function
+int fec_use_kernel(const char *name);    // "avx2", "ssse3" or "scalar"; -1 if the CPU lacks it
+const char *fec_kernel_name(void);
+
+uint8_t fec_coef(int row, int col);      // coefficient of data segment col in parity row
+void fec_muladd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len);  // dst ^= c * src
+
+// Fold data segment col, len bytes, into parity rows 0..k-1, stride bytes apart
+void fec_encode(uint8_t *rows, size_t stride, int k, int col, const void *data, size_t len);
+
+/*
+ * Recover e missing data segments. syn[r] holds what is left of parity row
+ * rows[r] with every present data segment (and the parity itself) folded
+ * in; cols lists the missing segments; out[c] receives segment cols[c].
+ * Every buffer is len bytes. Returns -1 if the rows and columns do not
+ * form an invertible system (repeated rows or columns).
+ */
+int fec_recover(uint8_t *const *syn, const int *rows, const int *cols, int e,
+                uint8_t *const *out, size_t len);
+
+// Parity segments a block of n needs so that, with segments lost
+// independently at rate loss, it fails with probability below FEC_RESIDUAL
+int fec_parity_for(double loss, int n, int max_k);
+
+#endif
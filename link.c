@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "link.h"
+
+int load_trace(link_trace *t, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    size_t cap = 4096;
+    unsigned long ms;
+
+    if (f == NULL) {
+        return -1;
+    }
+    memset(t, 0, sizeof(*t));
+    t->ops = malloc(cap * sizeof(uint32_t));
+    if (t->ops == NULL) {
+        error("malloc");
+    }
+    while (fscanf(f, "%lu", &ms) == 1) {
+        if (t->nops == cap) {
+            cap *= 2;
+            t->ops = realloc(t->ops, cap * sizeof(uint32_t));
+            if (t->ops == NULL) {
+                error("realloc");
+            }
+        }
+        t->ops[t->nops++] = ms;
+    }
+    fclose(f);
+
+    // The trace wraps around after its last opportunity
+    if (t->nops == 0 || t->ops[t->nops - 1] == 0) {
+        free_trace(t);
+        return -1;
+    }
+    t->period_ms = t->ops[t->nops - 1];
+    return 0;
+}
+
+void free_trace(link_trace *t)
+{
+    free(t->ops);
+    t->ops = NULL;
+    t->nops = 0;
+}
+
+static void fifo_push(link_fifo *q, link_pkt *p)
+{
+    p->next = NULL;
+    if (q->tail != NULL) {
+        q->tail->next = p;
+    } else {
+        q->head = p;
+    }
+    q->tail = p;
+    q->len++;
+}
+
+static link_pkt *fifo_pop(link_fifo *q)
+{
+    link_pkt *p = q->head;
+
+    if (p != NULL) {
+        q->head = p->next;
+        if (q->head == NULL) {
+            q->tail = NULL;
+        }
+        q->len--;
+    }
+    return p;
+}
+
+void link_init(link_state *l, const link_trace *trace, int queue_max,
+               uint64_t delay_us, double loss, double corrupt, unsigned int seed)
+{
+    memset(l, 0, sizeof(*l));
+    l->trace = trace;
+    l->queue_max = queue_max;
+    l->delay_us = delay_us;
+    l->loss = loss;
+    l->corrupt = corrupt;
+    l->seed = seed;
+}
+
+void link_free(link_state *l)
+{
+    link_pkt *p;
+
+    while ((p = fifo_pop(&l->queue)) != NULL) {
+        free(p);
+    }
+    while ((p = fifo_pop(&l->delay_line)) != NULL) {
+        free(p);
+    }
+    while ((p = l->free_list) != NULL) {
+        l->free_list = p->next;
+        free(p);
+    }
+}
+
+int link_open_log(link_state *l, const char *path)
+{
+    l->log = fopen(path, "w");
+    if (l->log == NULL) {
+        return -1;
+    }
+    fprintf(l->log, "time_ms,bytes,queue_delay_ms\n");
+    return 0;
+}
+
+static void log_packet(link_state *l, uint64_t now_us, int len, double qdelay_ms)
+{
+    if (l->log != NULL) {
+        fprintf(l->log, "%.3f,%d,%.3f\n", (now_us - l->start_us) / 1000.0, len, qdelay_ms);
+    }
+}
+
+static uint64_t next_opportunity(link_state *l)
+{
+    return l->period_start_us + (uint64_t)l->trace->ops[l->op_idx] * 1000;
+}
+
+/*
+ * Serve every delivery opportunity up to now: each one moves the packet at
+ * the head of the queue onto the delay line, and is wasted if the queue is
+ * empty (as in mahimahi, unused capacity does not accumulate).
+ */
+static void serve(link_state *l, uint64_t now_us)
+{
+    const link_trace *t = l->trace;
+    uint64_t period_us;
+
+    if (t == NULL || !l->arrived) {
+        return;
+    }
+    period_us = t->period_ms * 1000;
+    while (1) {
+        uint64_t at;
+
+        if (l->queue.head == NULL && now_us - l->period_start_us >= 2 * period_us) {
+            // Idle for whole periods: skip them instead of walking every opportunity
+            l->period_start_us += (now_us - l->period_start_us) / period_us * period_us - period_us;
+        }
+        at = next_opportunity(l);
+        if (at > now_us) {
+            break;
+        }
+        if (l->queue.head != NULL) {
+            link_pkt *p = fifo_pop(&l->queue);
+            uint64_t qdelay = at - p->enqueue_us;
+            uint64_t bucket = qdelay / LINK_HIST_US;
+
+            l->qdelay_hist[bucket < LINK_HIST_BUCKETS ? bucket : LINK_HIST_BUCKETS - 1]++;
+            log_packet(l, at, p->len, qdelay / 1000.0);
+            p->due_us = at + l->delay_us;
+            fifo_push(&l->delay_line, p);
+        }
+        if (++l->op_idx == t->nops) {
+            l->op_idx = 0;
+            l->period_start_us += period_us;
+        }
+    }
+}
+
+void link_enqueue(link_state *l, const void *data, int len, int flow, uint64_t now_us)
+{
+    link_pkt *p;
+
+    serve(l, now_us);  // opportunities before this arrival cannot carry it
+    if (!l->arrived++) {
+        l->start_us = l->period_start_us = now_us;  // the trace starts with the first packet
+    }
+
+    if (l->loss > 0 && rand_r(&l->seed) < l->loss * ((double)RAND_MAX + 1)) {
+        l->loss_drops++;
+        log_packet(l, now_us, len, -1);
+        return;
+    }
+    if (len > LINK_MAX_PKT || (l->trace != NULL && l->queue.len >= l->queue_max)) {
+        l->queue_drops++;
+        log_packet(l, now_us, len, -1);
+        return;
+    }
+
+    p = l->free_list;
+    if (p != NULL) {
+        l->free_list = p->next;
+    } else if ((p = malloc(sizeof(link_pkt))) == NULL) {
+        error("malloc");
+    }
+    memcpy(p->data, data, len);
+    p->len = len;
+    if (l->corrupt > 0 && rand_r(&l->seed) < l->corrupt * ((double)RAND_MAX + 1)) {
+        int bit = rand_r(&l->seed) % (len * 8);
+
+        p->data[bit / 8] ^= 1 << bit % 8;
+        l->corrupted++;
+    }
+    p->flow = flow;
+    p->enqueue_us = now_us;
+    if (l->trace == NULL) {
+        p->due_us = now_us + l->delay_us;
+        fifo_push(&l->delay_line, p);
+    } else {
+        fifo_push(&l->queue, p);
+    }
+}
+
+link_pkt *link_dequeue(link_state *l, uint64_t now_us)
+{
+    serve(l, now_us);
+    if (l->delay_line.head == NULL || l->delay_line.head->due_us > now_us) {
+        return NULL;
+    }
+    l->delivered++;
+    return fifo_pop(&l->delay_line);
+}
+
+void link_release(link_state *l, link_pkt *p)
+{
+    p->next = l->free_list;
+    l->free_list = p;
+}
+
+uint64_t link_next_event(link_state *l)
+{
+    uint64_t next = LINK_IDLE;
+
+    if (l->delay_line.head != NULL) {
+        next = l->delay_line.head->due_us;
+    }
+    if (l->queue.head != NULL && next_opportunity(l) < next) {
+        next = next_opportunity(l);
+    }
+    return next;
+}
+
+double link_qdelay_percentile(link_state *l, double p)
+{
+    unsigned long total = 0, seen = 0;
+
+    for (int i = 0; i < LINK_HIST_BUCKETS; i++) {
+        total += l->qdelay_hist[i];
+    }
+    for (int i = 0; i < LINK_HIST_BUCKETS && total > 0; i++) {
+        seen += l->qdelay_hist[i];
+        if (seen >= p * total) {
+            return (i + 1) * (double)LINK_HIST_US;
+        }
+    }
+    return 0;
+}
+
+void link_report(link_state *l, const char *name, FILE *out)
+{
+    fprintf(out, "%s: %lu arrived, %lu delivered, %lu queue drops, %lu random losses",
+            name, l->arrived, l->delivered, l->queue_drops, l->loss_drops);
+    if (l->corrupt > 0) {
+        fprintf(out, ", %lu corrupted", l->corrupted);
+    }
+    if (l->trace != NULL) {
+        fprintf(out, ", queueing delay p50 %.1f ms p99 %.1f ms",
+                link_qdelay_percentile(l, 0.5) / 1000, link_qdelay_percentile(l, 0.99) / 1000);
+    }
+    fprintf(out, "\n");
+}
@@ -0,0 +1,81 @@
+#ifndef LINK_H_INCLUDED
+#define LINK_H_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define LINK_MAX_PKT      2048   // Largest datagram a link carries
+#define LINK_HIST_US      100    // Queueing-delay histogram bucket width
+#define LINK_HIST_BUCKETS 20000  // Covers 0-2 s; longer delays land in the last bucket
+#define LINK_IDLE         UINT64_MAX
+
+/*
+ * A mahimahi-format trace: one line per delivery opportunity, giving the
+ * millisecond at which one MTU-sized packet may leave the bottleneck. The
+ * trace repeats with a period of its last timestamp.
+ */
+typedef struct {
+    uint32_t *ops;               // opportunity times in ms, non-decreasing
+    size_t nops;
+    uint64_t period_ms;
+} link_trace;
+
+typedef struct link_pkt {
+    struct link_pkt *next;
+    uint64_t enqueue_us;         // arrival at the link
+    uint64_t due_us;             // when it leaves the delay line
+    int flow;                    // caller's tag, e.g. which sender it came from
+    int len;
+    char data[LINK_MAX_PKT];
+} link_pkt;
+
+typedef struct {
+    link_pkt *head, *tail;
+    int len;
+} link_fifo;
+
+/*
+ * One direction of an emulated path: a drop-tail queue in front of a
+ * bottleneck that serves one packet per trace opportunity (or every packet
+ * at once without a trace), then a fixed propagation delay. Random loss,
+ * and corruption of one random bit of a datagram, are applied on arrival.
+ * The link never reads a clock; every call is given the current time in
+ * microseconds, so the same model runs against real time (link_emu) or a
+ * simulated one.
+ */
+typedef struct {
+    const link_trace *trace;     // NULL for a link limited only by its delay
+    int queue_max;               // drop-tail limit in packets
+    uint64_t delay_us;           // one-way propagation delay
+    double loss;                 // random loss probability per datagram
+    double corrupt;              // probability a datagram has one bit flipped
+    unsigned int seed;           // rand_r state, so runs are repeatable
+
+    uint64_t start_us;           // trace time 0, set by the first arrival
+    size_t op_idx;               // next opportunity within the trace
+    uint64_t period_start_us;    // start of the current trace period
+
+    link_fifo queue;             // waiting for a delivery opportunity
+    link_fifo delay_line;        // past the bottleneck, in propagation
+    link_pkt *free_list;
+
+    FILE *log;                   // per-packet queueing delay, NULL for none
+    unsigned long arrived, delivered, queue_drops, loss_drops, corrupted;
+    unsigned long qdelay_hist[LINK_HIST_BUCKETS];
+} link_state;
+
+int load_trace(link_trace *t, const char *path);   // -1 if the file cannot be read or is empty
+void free_trace(link_trace *t);
+
+void link_init(link_state *l, const link_trace *trace, int queue_max,
+               uint64_t delay_us, double loss, double corrupt, unsigned int seed);
+void link_free(link_state *l);
+int link_open_log(link_state *l, const char *path);       // CSV of queueing delays (-1 = dropped)
+void link_enqueue(link_state *l, const void *data, int len, int flow, uint64_t now_us);  // may drop
+link_pkt *link_dequeue(link_state *l, uint64_t now_us);  // next packet due by now, or NULL
+void link_release(link_state *l, link_pkt *p);            // returns a dequeued packet
+uint64_t link_next_event(link_state *l);                  // when to call again, LINK_IDLE if never
+double link_qdelay_percentile(link_state *l, double p);   // microseconds
+void link_report(link_state *l, const char *name, FILE *out);  // one-line summary
+
+#endif
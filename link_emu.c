@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "event.h"
+#include "link.h"
+
+/*
+ * link_emu: a trace-driven UDP relay that emulates a bottleneck path
+ * between rdt_sender and rdt_receiver, without an external mahimahi.
+ *
+ *   rdt_sender -> [listen_port] link_emu -> receiver_host:receiver_port
+ *
+ * Data from the sender goes through the uplink: a drop-tail queue released
+ * one datagram per trace opportunity, random loss, then the propagation
+ * delay. ACKs come back through the downlink, which only adds the delay
+ * unless -D gives it a trace of its own. -e flips one bit in that fraction
+ * of the datagrams, in both directions. SIGINT or SIGTERM prints a summary
+ * (drops, queueing delay percentiles) and exits.
+ *
+ * Several senders (say the stripes of rdt_sender -P, each on its own port)
+ * share the bottleneck. Like a NAT, the relay gives each sender address a
+ * socket of its own towards the receiver, so the receiver still tells them
+ * apart, and routes the ACKs arriving there back to that sender.
+ */
+#define DEFAULT_QUEUE    100  // packets
+#define DEFAULT_DELAY_MS 20   // one way
+#define MAX_FLOWS        256  // sender addresses relayed at once
+
+typedef struct {
+    struct sockaddr_in sender_addr;  // learned from its first datagram
+    int ack_sock;                    // faces the receiver
+    ev_io ack_io;
+} flow;
+
+event_loop loop;
+ev_io data_io;
+ev_timer link_timer;
+link_state uplink, downlink;
+
+int data_sock;                   // faces the senders
+flow flows[MAX_FLOWS];
+int nflows = 0;
+struct sockaddr_in receiver_addr;
+int rcvbuf = 4 << 20;
+
+// Forward everything either link has released by now, then sleep until
+// the next packet is due
+void pump_links()
+{
+    uint64_t now = now_us();
+    uint64_t next;
+    link_pkt *p;
+
+    while ((p = link_dequeue(&uplink, now)) != NULL) {
+        sendto(flows[p->flow].ack_sock, p->data, p->len, 0,
+               (struct sockaddr *)&receiver_addr, sizeof(receiver_addr));
+        link_release(&uplink, p);
+    }
+    while ((p = link_dequeue(&downlink, now)) != NULL) {
+        sendto(data_sock, p->data, p->len, 0,
+               (struct sockaddr *)&flows[p->flow].sender_addr, sizeof(struct sockaddr_in));
+        link_release(&downlink, p);
+    }
+
+    next = link_next_event(&uplink);
+    if (link_next_event(&downlink) < next) {
+        next = link_next_event(&downlink);
+    }
+    if (next != LINK_IDLE) {
+        ev_timer_start_at(&loop, &link_timer, next);
+    } else {
+        ev_timer_stop(&loop, &link_timer);
+    }
+}
+
+void on_link_timer(ev_timer *t, void *arg)
+{
+    pump_links();
+}
+
+void on_ack_readable(int fd, uint32_t events, void *arg);
+
+// The flow of a sender address, set up on its first datagram; -1 when the
+// table is full
+int find_flow(struct sockaddr_in *from)
+{
+    flow *f;
+
+    for (int i = 0; i < nflows; i++) {
+        if (flows[i].sender_addr.sin_port == from->sin_port &&
+            flows[i].sender_addr.sin_addr.s_addr == from->sin_addr.s_addr) {
+            return i;
+        }
+    }
+    if (nflows == MAX_FLOWS) {
+        return -1;
+    }
+    f = &flows[nflows];
+    f->sender_addr = *from;
+    f->ack_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (f->ack_sock < 0)
+        error("ERROR opening socket");
+    setsockopt(f->ack_sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    ev_add_io(&loop, &f->ack_io, f->ack_sock, EPOLLIN, on_ack_readable, (void *)(long)nflows);
+    return nflows++;
+}
+
+// Drain the senders' socket into the uplink
+void on_data_readable(int fd, uint32_t events, void *arg)
+{
+    char buf[LINK_MAX_PKT];
+    struct sockaddr_in from;
+    socklen_t fromlen = sizeof(from);
+    int n;
+
+    while ((n = recvfrom(fd, buf, sizeof(buf), MSG_DONTWAIT, (struct sockaddr *)&from, &fromlen)) >= 0) {
+        int f = find_flow(&from);
+
+        if (f >= 0) {
+            link_enqueue(&uplink, buf, n, f, now_us());
+        }
+        fromlen = sizeof(from);
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        error("recvfrom");
+    }
+    pump_links();
+}
+
+// Drain one flow's socket (ACKs from the receiver) into the downlink
+void on_ack_readable(int fd, uint32_t events, void *arg)
+{
+    char buf[LINK_MAX_PKT];
+    int n;
+
+    while ((n = recvfrom(fd, buf, sizeof(buf), MSG_DONTWAIT, NULL, NULL)) >= 0) {
+        link_enqueue(&downlink, buf, n, (int)(long)arg, now_us());
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        error("recvfrom");
+    }
+    pump_links();
+}
+
+void on_signal(int sig)
+{
+    ev_stop(&loop);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    int queue_max = DEFAULT_QUEUE;
+    double delay_ms = DEFAULT_DELAY_MS;
+    double loss = 0, corrupt = 0;
+    unsigned int seed = 1;
+    const char *log_path = NULL;
+    const char *down_path = NULL;
+    link_trace up_trace, down_trace;
+    struct sockaddr_in addr;
+
+    while ((opt = getopt(argc, argv, "d:D:e:l:o:q:s:")) != -1) {
+        switch (opt) {
+        case 'd':
+            delay_ms = atof(optarg);
+            break;
+        case 'D':
+            down_path = optarg;
+            break;
+        case 'e':
+            corrupt = atof(optarg);
+            break;
+        case 'l':
+            loss = atof(optarg);
+            break;
+        case 'o':
+            log_path = optarg;
+            break;
+        case 'q':
+            queue_max = atoi(optarg);
+            break;
+        case 's':
+            seed = atoi(optarg);
+            break;
+        default:
+            argc = 0;  // force the usage message
+        }
+    }
+    if (argc - optind != 4 || queue_max <= 0 || loss < 0 || loss >= 1 || corrupt < 0 || corrupt >= 1) {
+        fprintf(stderr, "usage: %s [-d delay_ms] [-D downlink_trace] [-e corrupt] [-l loss] [-o qdelay_log] "
+                "[-q queue_pkts] [-s seed] <listen_port> <receiver_host> <receiver_port> <uplink_trace>\n",
+                argv[0]);
+        exit(1);
+    }
+    if (load_trace(&up_trace, argv[optind + 3]) < 0) {
+        fprintf(stderr, "ERROR, cannot read trace %s\n", argv[optind + 3]);
+        exit(1);
+    }
+    if (down_path != NULL && load_trace(&down_trace, down_path) < 0) {
+        fprintf(stderr, "ERROR, cannot read trace %s\n", down_path);
+        exit(1);
+    }
+
+    link_init(&uplink, &up_trace, queue_max, delay_ms * 1000, loss, corrupt, seed);
+    // Its own seed, so the two directions do not corrupt the same datagrams
+    link_init(&downlink, down_path != NULL ? &down_trace : NULL, queue_max, delay_ms * 1000, 0, corrupt,
+              seed ^ 0x5bd1e995);
+    if (log_path != NULL && link_open_log(&uplink, log_path) < 0) {
+        error("Cannot open queueing delay log");
+    }
+
+    memset(&receiver_addr, 0, sizeof(receiver_addr));
+    receiver_addr.sin_family = AF_INET;
+    receiver_addr.sin_port = htons(atoi(argv[optind + 2]));
+    if (inet_aton(argv[optind + 1], &receiver_addr.sin_addr) == 0) {
+        fprintf(stderr, "ERROR, invalid host %s\n", argv[optind + 1]);
+        exit(1);
+    }
+
+    data_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (data_sock < 0)
+        error("ERROR opening socket");
+    // Bursts arrive faster than the trace drains them; the emulated queue, not
+    // the socket buffer, must be what overflows
+    setsockopt(data_sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(atoi(argv[optind]));
+    if (bind(data_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        error("ERROR on binding");
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    ev_init(&loop);
+    ev_timer_init(&link_timer, on_link_timer, NULL);
+    ev_add_io(&loop, &data_io, data_sock, EPOLLIN, on_data_readable, NULL);
+    ev_run(&loop);
+    ev_close(&loop);
+
+    link_report(&uplink, "uplink", stderr);
+    link_report(&downlink, "downlink", stderr);
+    if (uplink.log != NULL) {
+        fclose(uplink.log);
+    }
+    link_free(&uplink);
+    link_free(&downlink);
+    free_trace(&up_trace);
+    if (down_path != NULL) {
+        free_trace(&down_trace);
+    }
+    return 0;
+}
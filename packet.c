@@ -1,22 +1,70 @@
 #include <stdlib.h>
 #include"packet.h"
+#include"pool.h"
+#include"crc32c.h"
 
 static tcp_packet zero_packet = {.hdr={0}};
 /*
  * create TCP packet with header and space for data of size len
+ * Packets come from the calling thread's packet pool; release them with free_packet
  */
 tcp_packet* make_packet(int len)
 {
     tcp_packet *pkt;
-    pkt = malloc(TCP_HDR_SIZE + len);
+    pkt = pool_acquire();
 
     *pkt = zero_packet;
     pkt->hdr.data_size = len;
     return pkt;
 }
 
+void free_packet(tcp_packet *pkt)
+{
+    pool_release(pkt);
+}
+
 int get_data_size(tcp_packet *pkt)
 {
     return pkt->hdr.data_size;
 }
 
+/*
+ * Points *blocks at the SACK blocks carried by an ACK and returns how many
+ * there are; 0 for data packets and plain cumulative ACKs
+ */
+int get_sack_blocks(tcp_packet *pkt, sack_block **blocks)
+{
+    int n;
+
+    if (pkt->hdr.ctr_flags != ACK) {
+        return 0;
+    }
+    n = pkt->hdr.data_size / sizeof(sack_block);
+    if (n > MAX_SACK_BLOCKS) {
+        n = MAX_SACK_BLOCKS;
+    }
+    *blocks = (sack_block *)pkt->data;
+    return n;
+}
+
+// The CRC of the payload followed by the header, crc zeroed
+static uint32_t header_crc(const tcp_header *hdr, uint32_t payload_crc)
+{
+    tcp_header h = *hdr;
+
+    h.crc = 0;
+    return crc32c(payload_crc, &h, TCP_HDR_SIZE);
+}
+
+void packet_seal(tcp_header *hdr, uint32_t payload_crc)
+{
+    hdr->crc = header_crc(hdr, payload_crc);
+}
+
+int packet_intact(tcp_packet *pkt, int len, uint32_t payload_crc)
+{
+    return len >= (int)TCP_HDR_SIZE && pkt->hdr.data_size >= 0 &&
+           pkt->hdr.data_size <= (int)DATA_SIZE &&
+           len == (int)TCP_HDR_SIZE + pkt->hdr.data_size &&
+           pkt->hdr.crc == header_crc(&pkt->hdr, payload_crc);
+}
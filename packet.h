@@ -1,3 +1,8 @@
+#ifndef PACKET_H_INCLUDED
+#define PACKET_H_INCLUDED
+#include <stdint.h>
+#include <limits.h>
+
 enum packet_type {
     DATA,
     ACK,
@@ -8,17 +13,99 @@ typedef struct {
     int ackno;
     int ctr_flags;
     int data_size;
+    int conn_id;         // chosen by the sender, echoed in ACKs; tells concurrent uploads apart
+    uint32_t tsval;      // data: sender's microsecond clock at this transmission
+    uint32_t tsecr;      // ACK: tsval of the segment that triggered it, 0 for none
+    uint32_t crc;        // CRC32C of the datagram, see below
 }tcp_header;
 
+/*
+ * Timestamps (after RFC 7323): every transmission, first or repeated, is
+ * stamped with the low 32 bits of the sender's microsecond clock, and every
+ * ACK echoes the stamp of the segment it answers. The sender takes an RTT
+ * sample from each ACK as its own clock minus the echo (modulo 2^32), which
+ * is unambiguous even for retransmitted segments. tsval is never 0.
+ */
+
+/*
+ * Integrity: crc is the CRC32C (crc32c.h) of the payload followed by the
+ * header with crc itself zeroed, on every datagram: data, parity, ACK and
+ * EOF. With the payload first, a sender checksums a segment once and only
+ * re-seals the header for each retransmission. A datagram that fails it,
+ * or whose length is not TCP_HDR_SIZE + data_size, is dropped as if lost.
+ * On the EOF, tsecr is the CRC32C of all the data of the transfer (of its
+ * byte range, for a stripe), and the receiver checks what it wrote.
+ */
+
+/*
+ * End of transfer: once every segment is acknowledged the sender sends the
+ * EOF, a datagram with no payload, and resends it on its RTO until an ACK
+ * carrying EOF_ACK answers it. The receiver answers every copy it gets,
+ * also after it has closed the connection.
+ */
+#define EOF_ACK     0x80
+
+/*
+ * Striped transfers: one file split into byte ranges, each sent by a
+ * connection of its own. Their datagrams carry STRIPED in ctr_flags, the
+ * conn_ids of one file's stripes differ only in the STRIPE_MASK bits, and
+ * on a data segment (or the EOF) ackno is the file offset the range starts
+ * at; seqnos count from there.
+ */
+#define STRIPED     0x100
+#define STRIPE_BITS 6
+#define STRIPE_MASK ((1 << STRIPE_BITS) - 1)
+#define MAX_STRIPES (1 << STRIPE_BITS)
+
+/*
+ * Forward error correction (rdt_sender -F, see fec.h). New segments are
+ * grouped in blocks of n by segment number (seqno / DATA_SIZE), and a block
+ * may be followed by k parity segments. Each data segment of a block
+ * carries FEC and the block's n and k in ctr_flags, retransmissions
+ * included. A parity segment carries FEC_PARITY, n, k and its row, and its
+ * seqno is the end of the block (the seqno after its last segment), which
+ * also gives the length of a short last segment. In an ACK, seqno counts
+ * the segments the receiver has rebuilt from parity so far.
+ */
+#define FEC         0x200
+#define FEC_PARITY  0x400
+#define FEC_FLAGS(n, k)  ((n) << 16 | (k) << 24)
+#define FEC_ROW_FLAG(r)  ((r) << 11)
+#define FEC_N(flags)     ((flags) >> 16 & 0xff)
+#define FEC_K(flags)     ((flags) >> 24 & 0x1f)
+#define FEC_ROW(flags)   ((flags) >> 11 & 0x1f)
+
 #define MSS_SIZE    1500
 #define UDP_HDR_SIZE    8
 #define IP_HDR_SIZE    20
 #define TCP_HDR_SIZE    sizeof(tcp_header)
 #define DATA_SIZE   (MSS_SIZE - TCP_HDR_SIZE - UDP_HDR_SIZE - IP_HDR_SIZE)
+
+// seqno and a stripe's ackno are int byte offsets, so a transfer stops short
+// of INT_MAX by enough to name the end of an FEC block past its last byte
+#define MAX_FILE_SIZE   ((int)(INT_MAX - 256 * DATA_SIZE))
 typedef struct {
     tcp_header  hdr;
     char    data[0];
 }tcp_packet;
 
+/*
+ * Selective acknowledgements (RFC 2018 style). An ACK may carry up to
+ * MAX_SACK_BLOCKS blocks in its payload, each naming a byte range
+ * [start, end) the receiver holds above the cumulative ackno. The ACK's
+ * data_size is the number of payload bytes the blocks occupy.
+ */
+#define MAX_SACK_BLOCKS 4
+typedef struct {
+    int start;
+    int end;
+} sack_block;
+
 tcp_packet* make_packet(int seq);
+void free_packet(tcp_packet *pkt);
 int get_data_size(tcp_packet *pkt);
+int get_sack_blocks(tcp_packet *pkt, sack_block **blocks);  // returns the number of SACK blocks in an ACK
+void packet_seal(tcp_header *hdr, uint32_t payload_crc);    // fills in crc; payload_crc = crc32c(0, payload, data_size)
+int packet_intact(tcp_packet *pkt, int len, uint32_t payload_crc);  // whether a datagram of len bytes, its payload's CRC
+                                                                    // being payload_crc, is whole and passes its crc
+#endif
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "common.h"
+#include "pool.h"
+
+static __thread packet_pool thread_pool;
+
+void pool_init(size_t nblocks)
+{
+    packet_pool *p = &thread_pool;
+
+    if (p->arena != NULL) {
+        return;  // Already set up for this thread
+    }
+    p->arena = aligned_alloc(64, nblocks * POOL_BLOCK_SIZE);
+    if (p->arena == NULL) {
+        error("pool arena");
+    }
+    p->arena_end = p->arena + nblocks * POOL_BLOCK_SIZE;
+    p->nblocks = nblocks;
+
+    // Thread every block onto the free list, lowest address first
+    p->free_list = NULL;
+    for (size_t i = nblocks; i > 0; i--) {
+        void **block = (void **)(p->arena + (i - 1) * POOL_BLOCK_SIZE);
+        *block = p->free_list;
+        p->free_list = block;
+    }
+}
+
+void *pool_acquire(void)
+{
+    packet_pool *p = &thread_pool;
+    void **block;
+
+    if (p->arena == NULL) {
+        pool_init(POOL_DEFAULT_BLOCKS);
+    }
+    p->acquires++;
+
+    block = p->free_list;
+    if (block == NULL) {
+        p->fallbacks++;
+        block = malloc(POOL_BLOCK_SIZE);
+        if (block == NULL) {
+            error("malloc");
+        }
+        return block;
+    }
+    p->free_list = *block;
+    return block;
+}
+
+void pool_release(void *block)
+{
+    packet_pool *p = &thread_pool;
+
+    if (block == NULL) {
+        return;
+    }
+    if ((char *)block < p->arena || (char *)block >= p->arena_end) {
+        free(block);  // Came from the malloc fallback
+        return;
+    }
+    *(void **)block = p->free_list;
+    p->free_list = block;
+}
+
+packet_pool *pool_stats(void)
+{
+    return &thread_pool;
+}
@@ -0,0 +1,35 @@
+#ifndef POOL_H_INCLUDED
+#define POOL_H_INCLUDED
+
+#include <stddef.h>
+
+#include "packet.h"
+
+#define POOL_BLOCK_SIZE     1536    // MSS_SIZE rounded up to a cache-line multiple
+#define POOL_DEFAULT_BLOCKS 1024    // Arena size used when pool_init was not called
+
+/*
+ * Fixed-size packet pool. Each thread owns one contiguous arena of
+ * POOL_BLOCK_SIZE blocks and an intrusive free list threaded through the
+ * free blocks, so acquire and release are O(1) pointer swaps with no
+ * locking. When the arena runs dry, blocks fall back to malloc and are
+ * counted; pool_release tells the two apart by address.
+ *
+ * A block must be released by the thread that acquired it.
+ */
+typedef struct {
+    char *arena;
+    char *arena_end;
+    void *free_list;
+    size_t nblocks;
+
+    unsigned long acquires;
+    unsigned long fallbacks;        // acquires served by malloc because the arena was empty
+} packet_pool;
+
+void pool_init(size_t nblocks);     // sets up this thread's arena (optional)
+void *pool_acquire(void);           // one POOL_BLOCK_SIZE buffer
+void pool_release(void *block);
+packet_pool *pool_stats(void);      // this thread's pool, for reporting
+
+#endif
@@ -2,139 +2,873 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/types.h> 
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
-#include <assert.h>
 
 #include "common.h"
 #include "packet.h"
+#include "batch.h"
+#include "event.h"
+#include "sink.h"
+#include "pool.h"
+#include "evlog.h"
+#include "stats.h"
+#include "fec.h"
+#include "crc32c.h"
 
-/*
- * You are required to change the implementation to support
- * window size greater than one.
- * In the current implementation the window size is one, hence we have
- * only one send and receive packet
- */
-#define WINDOW_SIZE 10
-#define MAX_SEQ_NO 256000  // Large enough sequence number space
+#define WINDOW_SIZE 4096  // Default reassembly ring size in segments (a power of two)
+#define MAX_WINDOW_SIZE (1 << 20)  // Largest -w: the ring holds this many segments at most
+#define RECV_SOCKET_BUFFER (4 * 1024 * 1024)  // Requested SO_RCVBUF in bytes
+#define SYNC_INTERVAL_MS 1000                 // Default period between output file syncs
+#define CONN_HASH_BUCKETS 1024                // Connection table size per worker (a power of two)
+#define CONN_IDLE_MS 30000                    // Server mode: forget a connection silent for this long
+#define REAP_INTERVAL_MS 1000                 // Server mode: receive timeout between idle sweeps
+#define EOF_LINGER_MS 1000                    // Single transfer: exit once quiet this long after the EOF
+#define MAX_WORKERS 256
+#define FEC_BLOCKS 64                         // FEC blocks a connection can be rebuilding at once (a power of two)
 
 typedef struct {
     int received;        // Whether this packet has been received
-    tcp_packet *packet;  // The actual packet
+    tcp_packet *packet;  // The actual packet, a packet-pool block
+    int borrowed;        // packet is still owned by rx_batch
+    uint32_t crc;        // CRC32C of its payload
 } packet_buffer;
 
-packet_buffer recv_buffer[WINDOW_SIZE];  // Buffer for out-of-order packets
-tcp_packet *sndpkt;
-tcp_packet *recvpkt;  // Added declaration for recvpkt
-int next_expected_seqno = 0;  // Next expected sequence number
-int receiver_window_size = WINDOW_SIZE;
+/*
+ * Receive side of one FEC block (see fec.h). syn holds the block's k
+ * parity rows with every data segment received so far folded in, and the
+ * parity segments XORed in as they arrive: what is left of a row that has
+ * arrived sums the missing segments only. Once as many rows have arrived
+ * as segments are missing, fec_recover rebuilds them.
+ */
+typedef struct {
+    int block;                   // segment number / n; -1 for an unused slot
+    int n, k;
+    int end;                     // seqno after its last segment, from its parity; 0 until one arrives
+    int have;                    // data segments folded in
+    int done;                    // every segment is in, received or rebuilt
+    uint64_t got[FEC_MAX_DATA / 64];  // which of them
+    uint32_t rows;               // parity rows that have arrived
+    uint8_t *syn;                // k rows of DATA_SIZE bytes
+    int syn_rows;                // rows syn has room for
+} fec_block;
+
+/*
+ * One upload, identified by the conn_id its sender puts in every header.
+ * Out-of-order packets wait in a reassembly ring whose slots are indexed by
+ * segment number modulo the ring size, so storing a segment and advancing
+ * the head past a delivered one are both O(1); nothing is ever shifted.
+ *
+ * After its EOF a connection stays in the table, closed, until it has been
+ * idle for CONN_IDLE_MS, so a late duplicate cannot reopen (and truncate)
+ * its file, and a retransmitted EOF is still answered.
+ */
+typedef struct rdt_conn {
+    int id;
+    off_t base;                  // file offset seqno 0 goes to: a stripe's range start, else 0
+    struct sockaddr_in addr;     // where its ACKs go: the source of its latest datagram
+    packet_buffer *recv_buffer;
+    int next_expected_seqno;     // Next expected sequence number
+    int highest_buffered;        // end of the highest segment held in the ring
+    int unacked_segments;        // in-order segments received since the last ACK
+    uint32_t ts_echo;            // tsecr of the next ACK: tsval of the latest segment it answers
+    int closed;                  // EOF seen, output file closed
+    file_sink sink;              // segments are written in coalesced runs at the end of each batch
+    evlog *arrival_log;          // per-packet log, single-transfer mode only
+    uint64_t last_active_ms;
+    int dirty;                   // on the worker's list of connections this batch touched
+    struct rdt_conn *next;       // hash chain
+    struct rdt_conn *dirty_next;
+    fec_block *fec;              // FEC_BLOCKS slots, by block number; allocated by the first protected segment
+    int rebuilt;                 // segments rebuilt from parity, reported in every ACK
+    uint32_t file_crc;           // CRC32C of everything written, checked against the EOF's
+    stats_conn *st;              // live counters, published for rdt_stat
+} rdt_conn;
+
+// An ACK as it goes on the wire: header followed by its SACK blocks
+typedef struct {
+    tcp_header hdr;
+    sack_block sack[MAX_SACK_BLOCKS];
+} ack_packet;
+
+/*
+ * A worker owns one socket and every connection the kernel steers to it.
+ * With SO_REUSEPORT the kernel hashes each sender's address to one of the
+ * workers' sockets, so a connection never moves between workers and they
+ * share nothing: no locks on the data path.
+ */
+typedef struct {
+    int index;
+    int sockfd;
+    pthread_t thread;
+
+    // Batched receive/ACK path: one recvmmsg drains the socket, ACKs for the
+    // whole batch leave through one sendmmsg
+    recv_batch rx_batch;
+    send_batch ack_batch;
+    ack_packet ack_pkts[BATCH_MAX];  // ACKs queued in ack_batch
 
-// File for throughput data
-FILE *throughput_fp = NULL;
+    rdt_conn *conns[CONN_HASH_BUCKETS];
+    rdt_conn *dirty;                 // connections with data or ACKs pending from this batch
+    int open_conns;
+    uint64_t last_reap_ms;
+
+    unsigned long accepted, completed;       // connections
+    unsigned long writes, syncs;             // of connections already closed
+    unsigned long parity, rebuilt;           // FEC, of connections already closed
+    unsigned long mismatched;                // transfers whose data failed the EOF's CRC32C
+    unsigned long pool_acquires, pool_fallbacks;
+
+    // Its share of the metrics region: STATS_SLOTS_PER_WORKER connection
+    // slots from slot_base, handed out in order and reused once reaped.
+    // Connections beyond that share spare_slot, which rdt_stat never sees.
+    stats_worker *st;
+    int slot_base;
+    int next_slot;
+    int free_slots[STATS_SLOTS_PER_WORKER];
+    int nfree;
+    stats_conn spare_slot;
+} worker;
+
+// Settings shared by every connection
+int receiver_window_size = WINDOW_SIZE;  // Ring size in segments
+int ring_mask;                           // receiver_window_size - 1
+int ack_every = 0;                       // in-order segments per cumulative ACK (0 = one per batch)
+off_t prealloc = 0;                      // preallocate and mmap output files with this many bytes
+int sync_interval_ms = SYNC_INTERVAL_MS;
+const char *out_path;                    // the output file, or the prefix of one per upload
+int server_mode = 0;                     // -n: serve uploads until killed
+volatile sig_atomic_t stop = 0;
+stats_region stats;                      // live metrics for rdt_stat
+evlog throughput_log;                    // throughput_data.evlog (evlog.py makes throughput_data.txt of it)
+
+worker workers[MAX_WORKERS];
 
 /*
- * Initialize the packet buffer
- * Sets all buffer slots to empty (received=0, packet=NULL)
+ * Set the ring size shared by every connection
+ * Rounds size up to a power of two
  */
-void init_packet_buffer() {
-    for (int i = 0; i < WINDOW_SIZE; i++) {
-        recv_buffer[i].received = 0;
-        recv_buffer[i].packet = NULL;
+void init_packet_buffer(int size) {
+    int slots = 1;
+
+    while (slots < size) {
+        slots <<= 1;
     }
+    receiver_window_size = slots;
+    ring_mask = slots - 1;
 }
 
-// Function to get window index for a sequence number
+// Function to get the ring slot for a sequence number
 int get_window_index(int seqno) {
-    return ((seqno - next_expected_seqno) / DATA_SIZE) % WINDOW_SIZE;
+    return (seqno / DATA_SIZE) & ring_mask;
 }
 
 // Free a packet in the buffer
-void free_packet_buffer(int index) {
-    if (recv_buffer[index].packet != NULL) {
-        free(recv_buffer[index].packet);
-        recv_buffer[index].packet = NULL;
+void free_packet_buffer(rdt_conn *c, int index) {
+    packet_buffer *slot = &c->recv_buffer[index];
+
+    if (slot->packet != NULL && !slot->borrowed) {
+        free_packet(slot->packet);
     }
-    recv_buffer[index].received = 0;
+    slot->packet = NULL;
+    slot->received = 0;
+    slot->borrowed = 0;
 }
 
 // Write contiguous packets to file
-void write_contiguous_packets(FILE *fp) {
-    int window_index = 0;
-    
+// The sink keeps referencing the packets until sink_flush, then returns the taken ones to the pool
+void write_contiguous_packets(rdt_conn *c) {
+    int window_index = get_window_index(c->next_expected_seqno);
+
     // Write all contiguous packets from the buffer
-    while (window_index < WINDOW_SIZE && recv_buffer[window_index].received) {
-        tcp_packet *pkt = recv_buffer[window_index].packet;
-        
-        // Write packet data to file
-        fseek(fp, pkt->hdr.seqno, SEEK_SET);
-        int bytes_written = fwrite(pkt->data, 1, pkt->hdr.data_size, fp);
-        VLOG(DEBUG, "Wrote %d bytes at position %d to file", bytes_written, pkt->hdr.seqno);
-        fflush(fp);
-        
+    while (c->recv_buffer[window_index].received) {
+        tcp_packet *pkt = c->recv_buffer[window_index].packet;
+
         // Update next expected sequence number
-        next_expected_seqno = pkt->hdr.seqno + pkt->hdr.data_size;
-        
-        // Free this packet
-        free_packet_buffer(window_index);
-        
-        // Shift the window
-        for (int i = 0; i < WINDOW_SIZE-1; i++) {
-            recv_buffer[i] = recv_buffer[i+1];
+        c->next_expected_seqno = pkt->hdr.seqno + pkt->hdr.data_size;
+
+        // Queue packet data for the file; ownership of a taken packet passes to the
+        // sink, which may release it right away, so pkt is not touched afterwards
+        VLOG(DEBUG, "Wrote %d bytes at position %d to file", pkt->hdr.data_size, pkt->hdr.seqno);
+        if (!c->recv_buffer[window_index].borrowed) {
+            c->st->r.held_segments--;  // it had waited in the ring for a hole to fill
         }
-        
-        // Clear the last slot
-        recv_buffer[WINDOW_SIZE-1].received = 0;
-        recv_buffer[WINDOW_SIZE-1].packet = NULL;
+        c->file_crc = crc32c_combine(c->file_crc, c->recv_buffer[window_index].crc, pkt->hdr.data_size);
+        sink_write(&c->sink, c->base + pkt->hdr.seqno, pkt->data, pkt->hdr.data_size,
+                   c->recv_buffer[window_index].borrowed ? NULL : pkt);
+
+        // Clear the slot and advance the head
+        c->recv_buffer[window_index].received = 0;
+        c->recv_buffer[window_index].packet = NULL;
+        c->recv_buffer[window_index].borrowed = 0;
+        window_index = (window_index + 1) & ring_mask;
     }
 }
 
-int main(int argc, char **argv) {
-    int sockfd; /* socket */
-    int portno; /* port to listen on */
-    int clientlen; /* byte size of client's address */
-    struct sockaddr_in serveraddr; /* server's addr */
-    struct sockaddr_in clientaddr; /* client addr */
-    int optval; /* flag value for setsockopt */
-    FILE *fp;
-    char buffer[MSS_SIZE];
-    struct timeval tp;
+// Keep a segment, whose payload CRC is crc, in its ring slot until the hole
+// below it fills; a borrowed packet is still rx_batch's and must be
+// delivered in this batch
+void hold_segment(rdt_conn *c, tcp_packet *pkt, int borrowed, uint32_t crc) {
+    packet_buffer *slot = &c->recv_buffer[get_window_index(pkt->hdr.seqno)];
+
+    slot->packet = pkt;
+    slot->borrowed = borrowed;
+    slot->crc = crc;
+    slot->received = 1;
+    if (!borrowed && ++c->st->r.held_segments > c->st->r.max_held_segments) {
+        c->st->r.max_held_segments = c->st->r.held_segments;
+    }
+    c->st->r.bytes_received += pkt->hdr.data_size;
+    if (pkt->hdr.seqno + pkt->hdr.data_size > c->highest_buffered) {
+        c->highest_buffered = pkt->hdr.seqno + pkt->hdr.data_size;
+    }
+}
+
+// The FEC slot of a block with n data and k parity segments, taken over if
+// it holds an older block; NULL once the block is done, or if a newer one
+// has taken its slot
+fec_block *fec_block_for(rdt_conn *c, int block, int n, int k) {
+    fec_block *b;
+
+    if (c->fec == NULL) {
+        c->fec = calloc(FEC_BLOCKS, sizeof(fec_block));
+        if (c->fec == NULL) {
+            error("calloc");
+        }
+        for (int i = 0; i < FEC_BLOCKS; i++) {
+            c->fec[i].block = -1;
+        }
+    }
+    b = &c->fec[block & (FEC_BLOCKS - 1)];
+    if (b->block == block) {
+        return b->done ? NULL : b;
+    }
+    if (b->block > block) {
+        return NULL;
+    }
+    if (b->syn_rows < k) {
+        free(b->syn);
+        b->syn = malloc((size_t)k * DATA_SIZE);
+        if (b->syn == NULL) {
+            error("malloc");
+        }
+        b->syn_rows = k;
+    }
+    memset(b->syn, 0, (size_t)k * DATA_SIZE);
+    memset(b->got, 0, sizeof(b->got));
+    b->block = block;
+    b->n = n;
+    b->k = k;
+    b->end = 0;
+    b->have = 0;
+    b->done = 0;
+    b->rows = 0;
+    return b;
+}
+
+// Data segments in a block: n, or fewer in the last block of the file
+int fec_block_segments(fec_block *b) {
+    int last;
+
+    if (b->end == 0) {
+        return b->n;
+    }
+    last = (b->end - 1) / DATA_SIZE - b->block * b->n;
+    return last + 1 < b->n ? last + 1 : b->n;
+}
+
+/*
+ * Rebuild a block's missing segments if enough parity has arrived and they
+ * all fit in the ring, and hold them there like segments that arrived out
+ * of order. Returns how many were rebuilt.
+ */
+int fec_rebuild(rdt_conn *c, fec_block *b) {
+    int nseg = fec_block_segments(b);
+    int missing = nseg - b->have;
+    int start = b->block * b->n * DATA_SIZE;
+    int len = b->end - start < DATA_SIZE ? b->end - start : DATA_SIZE;
+    int rows[FEC_MAX_PARITY], cols[FEC_MAX_PARITY];
+    uint8_t *syn[FEC_MAX_PARITY], *out[FEC_MAX_PARITY];
+    tcp_packet *pkts[FEC_MAX_PARITY];
+    int e = 0;
+
+    if (missing == 0 || __builtin_popcount(b->rows) < missing) {
+        return 0;
+    }
+    for (int j = 0; j < nseg; j++) {
+        int seqno = start + j * DATA_SIZE;
+
+        if (!(b->got[j / 64] >> (j % 64) & 1)) {
+            if ((int64_t)seqno - c->next_expected_seqno >= (int64_t)receiver_window_size * DATA_SIZE) {
+                return 0;  // beyond the ring for now
+            }
+            if (seqno < c->next_expected_seqno || c->recv_buffer[get_window_index(seqno)].received) {
+                return 0;  // arrived without being folded in; nothing to rebuild
+            }
+            cols[e++] = j;
+        }
+    }
+    for (int r = 0, i = 0; i < missing; r++) {
+        if (b->rows >> r & 1) {
+            rows[i] = r;
+            syn[i++] = b->syn + (size_t)r * DATA_SIZE;
+        }
+    }
+    for (int i = 0; i < missing; i++) {
+        pkts[i] = make_packet(0);
+        out[i] = (uint8_t *)pkts[i]->data;
+    }
+    if (fec_recover(syn, rows, cols, missing, out, len) < 0) {
+        for (int i = 0; i < missing; i++) {
+            free_packet(pkts[i]);
+        }
+        return 0;
+    }
+    for (int i = 0; i < missing; i++) {
+        tcp_packet *pkt = pkts[i];
+        int seqno = start + cols[i] * DATA_SIZE;
+
+        pkt->hdr.seqno = seqno;
+        pkt->hdr.data_size = b->end - seqno < DATA_SIZE ? b->end - seqno : DATA_SIZE;
+        pkt->hdr.conn_id = c->id;
+        pkt->hdr.ctr_flags = FEC | FEC_FLAGS(b->n, b->k);
+        hold_segment(c, pkt, 0, crc32c(0, pkt->data, pkt->hdr.data_size));
+        VLOG(DEBUG, "Rebuilt packet with seqno %d from parity", seqno);
+    }
+    b->done = 1;
+    c->rebuilt += missing;
+    c->st->r.rebuilt = c->rebuilt;
+    return missing;
+}
+
+// Fold a newly held data segment into its block's parity rows
+void fec_fold_segment(rdt_conn *c, tcp_packet *pkt) {
+    int n = FEC_N(pkt->hdr.ctr_flags), k = FEC_K(pkt->hdr.ctr_flags);
+    int seg = pkt->hdr.seqno / DATA_SIZE;
+    fec_block *b;
+
+    if (k == 0 || n == 0 || n > FEC_MAX_DATA || k > FEC_MAX_PARITY) {
+        return;
+    }
+    b = fec_block_for(c, seg / n, n, k);
+    if (b == NULL || b->got[seg % n / 64] >> (seg % n % 64) & 1) {
+        return;
+    }
+    b->got[seg % n / 64] |= 1ULL << (seg % n % 64);
+    b->have++;
+    fec_encode(b->syn, DATA_SIZE, k, seg % n, pkt->data, pkt->hdr.data_size);
+    if (b->have == fec_block_segments(b)) {
+        b->done = 1;
+    } else {
+        fec_rebuild(c, b);
+    }
+}
+
+/*
+ * Take in a parity segment. Returns 1 if its block still needed it: the
+ * parity filled its holes, or they remain and the sender should hear (from
+ * the ACK's timestamp echo) that the parity did not suffice.
+ */
+int fec_take_parity(rdt_conn *c, tcp_packet *pkt) {
+    int flags = pkt->hdr.ctr_flags;
+    int n = FEC_N(flags), k = FEC_K(flags), row = FEC_ROW(flags);
+    int end = pkt->hdr.seqno;
+    fec_block *b;
+
+    if (n == 0 || n > FEC_MAX_DATA || k > FEC_MAX_PARITY || row >= k || end <= c->next_expected_seqno) {
+        return 0;
+    }
+    b = fec_block_for(c, (end - 1) / DATA_SIZE / n, n, k);
+    if (b == NULL || b->rows >> row & 1) {
+        return 0;
+    }
+    b->rows |= 1u << row;
+    b->end = end;
+    fec_muladd(b->syn + (size_t)row * DATA_SIZE, (uint8_t *)pkt->data, 1, pkt->hdr.data_size);
+    if (b->have == fec_block_segments(b)) {
+        b->done = 1;
+        return 0;
+    }
+    fec_rebuild(c, b);
+    return 1;
+}
+
+/*
+ * Fill in SACK blocks describing the runs of out-of-order segments held in
+ * the connection's ring, lowest first. Only the span up to highest_buffered
+ * is scanned. Returns the number of blocks written.
+ */
+int build_sack_blocks(rdt_conn *c, sack_block *sack) {
+    packet_buffer *ring = c->recv_buffer;
+    int n = 0;
+    int seqno = c->next_expected_seqno + DATA_SIZE;  // next_expected_seqno itself is the hole
+
+    while (seqno < c->highest_buffered && n < MAX_SACK_BLOCKS) {
+        if (!ring[get_window_index(seqno)].received) {
+            seqno += DATA_SIZE;
+            continue;
+        }
+        tcp_packet *first = ring[get_window_index(seqno)].packet;
+        tcp_packet *last = first;
+        while (seqno < c->highest_buffered && ring[get_window_index(seqno)].received) {
+            last = ring[get_window_index(seqno)].packet;
+            seqno += DATA_SIZE;
+        }
+        sack[n].start = first->hdr.seqno;
+        sack[n].end = last->hdr.seqno + last->hdr.data_size;
+        n++;
+    }
+    return n;
+}
+
+// Queue a cumulative ACK for everything delivered so far, plus SACK blocks for what is buffered beyond it;
+// once the connection is closed, the acknowledgement of its EOF
+void queue_ack(worker *w, rdt_conn *c) {
+    ack_packet *ack = &w->ack_pkts[w->ack_batch.count];
+    int nsack;
+
+    memset(&ack->hdr, 0, sizeof(ack->hdr));
+    ack->hdr.ackno = c->next_expected_seqno;
+    ack->hdr.ctr_flags = c->closed ? ACK | EOF_ACK : ACK;
+    ack->hdr.conn_id = c->id;
+    ack->hdr.seqno = c->rebuilt;
+    ack->hdr.tsecr = c->ts_echo;
+    nsack = c->closed ? 0 : build_sack_blocks(c, ack->sack);
+    ack->hdr.data_size = nsack * sizeof(sack_block);
+    packet_seal(&ack->hdr, crc32c(0, ack->sack, ack->hdr.data_size));
+    batch_set_addr(&w->ack_batch, &c->addr);
+    batch_add(&w->ack_batch, ack, TCP_HDR_SIZE + ack->hdr.data_size);
+    c->unacked_segments = 0;
+    c->st->r.acks_sent++;
+}
+
+static unsigned int conn_hash(int id) {
+    return ((unsigned int)id * 2654435761u) >> 22 & (CONN_HASH_BUCKETS - 1);
+}
+
+rdt_conn *conn_lookup(worker *w, int id) {
+    rdt_conn *c = w->conns[conn_hash(id)];
+
+    while (c != NULL && c->id != id) {
+        c = c->next;
+    }
+    return c;
+}
+
+// A metrics slot for a new connection, cleared; the spare when all are taken
+stats_conn *stats_slot_acquire(worker *w) {
+    stats_conn *st;
+
+    if (w->nfree > 0) {
+        st = &stats.conns[w->slot_base + w->free_slots[--w->nfree]];
+    } else if (w->next_slot < STATS_SLOTS_PER_WORKER) {
+        st = &stats.conns[w->slot_base + w->next_slot++];
+    } else {
+        st = &w->spare_slot;
+    }
+    memset(st, 0, sizeof(*st));
+    return st;
+}
+
+// Give a forgotten connection's slot back
+void stats_slot_release(worker *w, stats_conn *st) {
+    if (st == &w->spare_slot) {
+        return;
+    }
+    st->state = STATS_FREE;
+    w->free_slots[w->nfree++] = st - stats.conns - w->slot_base;
+}
+
+// Count the file writes a connection's sink made since the last call
+void publish_writes(worker *w, rdt_conn *c) {
+    unsigned long n = c->sink.writes + c->sink.syncs;
+
+    w->st->write_syscalls += n - c->st->r.writes;
+    c->st->r.writes = n;
+}
+
+// Start receiving a new upload, or one stripe of it, from its first datagram
+// pkt: its ring, its output file and, for a single transfer, throughput_data.evlog
+rdt_conn *conn_open(worker *w, tcp_packet *pkt) {
+    rdt_conn *c = calloc(1, sizeof(rdt_conn));
+    char path[4096];
+    int id = pkt->hdr.conn_id;
+    int striped = pkt->hdr.ctr_flags & STRIPED;
+    unsigned int h = conn_hash(id);
+
+    if (c == NULL) {
+        error("calloc");
+    }
+    c->id = id;
+    c->recv_buffer = calloc(receiver_window_size, sizeof(packet_buffer));
+    if (c->recv_buffer == NULL) {
+        error("calloc");
+    }
+
+    // The stripes of a file, whichever workers they land on, all write
+    // their ranges into the one named after the conn_id they share
+    if (striped) {
+        c->base = pkt->hdr.ackno;
+    }
+    if (server_mode) {
+        snprintf(path, sizeof(path), "%s.%08x", out_path,
+                 (unsigned int)(striped ? id & ~STRIPE_MASK : id));
+    } else {
+        snprintf(path, sizeof(path), "%s", out_path);
+    }
+    sink_open(&c->sink, path, prealloc, sync_interval_ms, striped);
+    c->sink.release = pool_release;
+
+    if (!server_mode) {
+        // Open throughput data file for performance analysis; a writer
+        // thread takes the per-packet records off the receive path
+        if (evlog_open(&throughput_log, "throughput_data.evlog") < 0) {
+            error("Cannot open throughput_data.evlog");
+        }
+        c->arrival_log = &throughput_log;
+    }
 
-    /* 
-     * check command line arguments 
+    c->next = w->conns[h];
+    w->conns[h] = c;
+    w->open_conns++;
+    w->accepted++;
+    c->st = stats_slot_acquire(w);
+    c->st->conn_id = id;
+    c->st->worker = w->index;
+    c->st->start_us = now_us();
+    c->st->state = STATS_ACTIVE;
+    VLOG(INFO, "Worker %d: connection %08x started, writing %s at %lld", w->index,
+         (unsigned int)id, path, (long long)c->base);
+    return c;
+}
+
+// EOF (or abandoned): finish the output file and drop the reassembly state
+void conn_close(worker *w, rdt_conn *c) {
+    if (c->closed) {
+        return;
+    }
+    sink_close(&c->sink);
+    publish_writes(w, c);
+    c->st->r.held_segments = 0;
+    c->st->end_us = now_us();
+    c->st->state = STATS_DONE;
+    if (c->arrival_log != NULL) {
+        evlog_close(c->arrival_log);  // Close throughput data file
+        c->arrival_log = NULL;
+    }
+    // Cleanup any remaining packets in the buffer
+    for (int i = 0; i < receiver_window_size; i++) {
+        free_packet_buffer(c, i);
+    }
+    free(c->recv_buffer);
+    c->recv_buffer = NULL;
+    if (c->fec != NULL) {
+        for (int i = 0; i < FEC_BLOCKS; i++) {
+            free(c->fec[i].syn);
+        }
+        free(c->fec);
+        c->fec = NULL;
+    }
+    c->closed = 1;
+    w->open_conns--;
+    w->writes += c->sink.writes;
+    w->syncs += c->sink.syncs;
+    w->parity += c->st->r.parity_received;
+    w->rebuilt += c->rebuilt;
+}
+
+// Close and forget every connection idle for CONN_IDLE_MS (all of them if force)
+void reap_connections(worker *w, uint64_t now_ms, int force) {
+    for (int h = 0; h < CONN_HASH_BUCKETS; h++) {
+        rdt_conn **link = &w->conns[h];
+
+        while (*link != NULL) {
+            rdt_conn *c = *link;
+
+            if (!force && now_ms - c->last_active_ms < CONN_IDLE_MS) {
+                link = &c->next;
+                continue;
+            }
+            if (!c->closed) {
+                VLOG(WARNING, "Worker %d: connection %08x abandoned at %d bytes",
+                     w->index, (unsigned int)c->id, c->next_expected_seqno);
+                conn_close(w, c);
+            }
+            *link = c->next;
+            stats_slot_release(w, c->st);
+            free(c);
+        }
+    }
+    w->last_reap_ms = now_ms;
+}
+
+// Hold a data segment in the ring if it is new and fits, and fold it into
+// its FEC block
+void receive_segment(worker *w, rdt_conn *c, int i, struct timeval *tp) {
+    tcp_packet *recvpkt = (tcp_packet *) w->rx_batch.bufs[i];
+
+    c->st->r.segments_received++;
+
+    // Log throughput data to both console and file
+    VLOG(DEBUG, "%lu, %d, %d", tp->tv_sec, recvpkt->hdr.data_size, recvpkt->hdr.seqno);
+
+    // Write to throughput data file
+    if (c->arrival_log != NULL) {
+        evlog_record r = {.type = EVLOG_RECV, .conn_id = c->id,
+                          .time = tp->tv_sec * 1000000LL + tp->tv_usec,
+                          .arg = recvpkt->hdr.seqno, .value = recvpkt->hdr.data_size};
+
+        evlog_put(c->arrival_log, &r);
+    }
+
+    /*
+     * Check if the received packet is within our window
+     * We accept packets if:
+     * 1. seqno >= next_expected_seqno (not older than what we expect)
+     * 2. seqno < next_expected_seqno + window_size*DATA_SIZE (within our window)
      */
-    if (argc != 3) {
-        fprintf(stderr, "usage: %s <port> FILE_RECVD\n", argv[0]);
-        exit(1);
+    if (recvpkt->hdr.seqno >= c->next_expected_seqno &&
+        (int64_t)recvpkt->hdr.seqno - c->next_expected_seqno < (int64_t)receiver_window_size * DATA_SIZE) {
+        int window_index = get_window_index(recvpkt->hdr.seqno);
+
+        // Save the packet in our buffer if we haven't received it yet
+        if (!c->recv_buffer[window_index].received) {
+            if (recvpkt->hdr.seqno == c->next_expected_seqno) {
+                // Delivered before the next batch_recv, so it can stay in rx_batch
+                hold_segment(c, recvpkt, 1, w->rx_batch.crcs[i]);
+            } else {
+                // Keep the pool buffer itself; rx_batch gets a fresh one
+                hold_segment(c, batch_take(&w->rx_batch, i), 0, w->rx_batch.crcs[i]);
+                c->st->r.out_of_order++;
+            }
+            VLOG(DEBUG, "Stored packet with seqno %d at window index %d, data_size: %d",
+                 recvpkt->hdr.seqno, window_index, recvpkt->hdr.data_size);
+            if (recvpkt->hdr.ctr_flags & FEC) {
+                fec_fold_segment(c, recvpkt);
+            }
+        } else {
+            c->st->r.duplicates++;
+        }
+    } else if (recvpkt->hdr.seqno < c->next_expected_seqno) {
+        c->st->r.duplicates++;
     }
-    portno = atoi(argv[1]);
+}
+
+// Process datagram i of the worker's current batch
+void handle_datagram(worker *w, int i, struct timeval *tp, uint64_t now_ms) {
+    tcp_packet *recvpkt = (tcp_packet *) w->rx_batch.bufs[i];
+    rdt_conn *c;
+
+    c = conn_lookup(w, recvpkt->hdr.conn_id);
+    if (c == NULL) {
+        if (!server_mode && w->accepted > 0) {
+            return;  // A single transfer only takes its own connection's datagrams
+        }
+        c = conn_open(w, recvpkt);
+    }
+    c->last_active_ms = now_ms;
+    c->addr = w->rx_batch.addrs[i];
+    if (c->closed) {
+        if (recvpkt->hdr.data_size == 0) {
+            queue_ack(w, c);  // the sender missed our answer to its EOF
+        }
+        return;
+    }
+
+    // Check if this is the EOF packet
+    if (recvpkt->hdr.data_size == 0) {
+        VLOG(INFO, "End Of File has been reached");
+        c->st->r.file_crc = c->file_crc;
+        if (recvpkt->hdr.tsecr == c->file_crc) {
+            c->st->r.verified = 1;
+        } else {
+            VLOG(WARNING, "Connection %08x: CRC32C of the data written is %08x, the sender's %08x",
+                 (unsigned int)c->id, c->file_crc, recvpkt->hdr.tsecr);
+            c->st->r.verified = -1;
+            w->mismatched++;
+        }
+        conn_close(w, c);
+        queue_ack(w, c);
+        w->completed++;
+        return;
+    }
+
+    int in_order = 0;
+    if (recvpkt->hdr.ctr_flags & FEC_PARITY) {
+        c->st->r.parity_received++;
+        if (!fec_take_parity(c, recvpkt)) {
+            return;  // Its block is complete, or beyond help
+        }
+    } else {
+        receive_segment(w, c, i, tp);
+    }
+
+    // Deliver what is now contiguous; only advance on in-order data
+    if (c->recv_buffer[get_window_index(c->next_expected_seqno)].received) {
+        write_contiguous_packets(c);
+        in_order = 1;
+    }
+
+    /*
+     * In-order segments are acknowledged cumulatively, once per batch or
+     * every ack_every segments. Anything else (a gap, a duplicate, a
+     * segment outside the window) is acknowledged immediately so the
+     * sender still sees the duplicate ACKs that drive fast retransmit.
+     * The ACK echoes the timestamp of the latest segment it answers: an
+     * ACK is held back at most until the end of the batch, and the newest
+     * segment is the one whose round trip congestion control wants.
+     */
+    c->ts_echo = recvpkt->hdr.tsval;
+    if (in_order) {
+        c->unacked_segments++;
+        if (ack_every > 0 && c->unacked_segments >= ack_every) {
+            queue_ack(w, c);
+        }
+    } else {
+        queue_ack(w, c);
+    }
+    if (!c->dirty) {
+        c->dirty = 1;
+        c->dirty_next = w->dirty;
+        w->dirty = c;
+    }
+}
+
+// Make every receive on sockfd give up after ms without a datagram
+void set_recv_timeout(int sockfd, int ms) {
+    struct timeval tv = {.tv_sec = ms / 1000, .tv_usec = ms % 1000 * 1000};
+
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+/*
+ * Receive until the single transfer's EOF has been answered and the sender
+ * has gone quiet or, in server mode, until stopped.
+ * Every batch ends by acknowledging and writing out each connection it
+ * touched, before rx_batch (which in-order data still points into) is reused.
+ */
+void worker_run(worker *w) {
+    struct timeval tp;
+    unsigned long quiet_datagrams = 0;  // single transfer: datagrams received by quiet_since_ms
+    uint64_t quiet_since_ms = 0;
 
-    fp = fopen(argv[2], "w");
-    if (fp == NULL) {
-        error(argv[2]);
+    // Every packet is either in rx_batch, in a reassembly ring or waiting in a sink
+    pool_init(BATCH_MAX + receiver_window_size + SINK_MAX_IOV);
+    init_recv_batch(&w->rx_batch, w->sockfd);
+    init_send_batch(&w->ack_batch, w->sockfd, NULL, sizeof(struct sockaddr_in), BATCH_MAX, 0);
+    w->st = &stats.workers[w->index];
+    w->slot_base = w->index * STATS_SLOTS_PER_WORKER;
+    w->last_reap_ms = now_us() / 1000;
+
+    while (!stop) {
+        // Receive every UDP datagram already queued from the clients
+        int n = batch_recv(&w->rx_batch);
+        uint64_t now_ms = now_us() / 1000;
+        gettimeofday(&tp, NULL);
+
+        for (int i = 0; i < n; i++) {
+            handle_datagram(w, i, &tp, now_ms);
+        }
+
+        // Send the cumulative ACKs for this batch back to the clients, then
+        // write its in-order data
+        for (rdt_conn *c = w->dirty; c != NULL; c = c->dirty_next) {
+            if (!c->closed && c->unacked_segments > 0) {
+                queue_ack(w, c);
+            }
+        }
+        batch_flush(&w->ack_batch);
+        for (rdt_conn *c = w->dirty; c != NULL; c = c->dirty_next) {
+            c->dirty = 0;
+            if (!c->closed) {
+                sink_flush(&c->sink);
+                publish_writes(w, c);
+            }
+        }
+        w->dirty = NULL;
+        w->st->recv_syscalls = w->rx_batch.syscalls;
+        w->st->datagrams_received = w->rx_batch.datagrams;
+        w->st->corrupt = w->rx_batch.corrupt;
+        w->st->send_syscalls = w->ack_batch.syscalls;
+        w->st->datagrams_sent = w->ack_batch.datagrams;
+
+        // After the EOF, stay to answer its retransmissions, in case our
+        // ACK of it was lost, until the sender has been quiet for a while
+        if (!server_mode && w->completed > 0) {
+            if (quiet_since_ms == 0) {
+                set_recv_timeout(w->sockfd, EOF_LINGER_MS);
+            }
+            if (quiet_since_ms == 0 || w->rx_batch.datagrams != quiet_datagrams) {
+                quiet_datagrams = w->rx_batch.datagrams;
+                quiet_since_ms = now_ms;
+            } else if (now_ms - quiet_since_ms >= EOF_LINGER_MS) {
+                break;
+            }
+        }
+        if (server_mode && now_ms - w->last_reap_ms >= REAP_INTERVAL_MS) {
+            reap_connections(w, now_ms, 0);
+        }
     }
-    
-    // Open throughput data file for performance analysis
-    throughput_fp = fopen("throughput_data.txt", "w");
-    if (throughput_fp == NULL) {
-        error("Cannot open throughput_data.txt");
+    reap_connections(w, now_us() / 1000, 1);
+
+    w->pool_acquires = pool_stats()->acquires;
+    w->pool_fallbacks = pool_stats()->fallbacks;
+}
+
+// Server mode: one worker per thread, pinned to its own core
+void *worker_thread(void *arg) {
+    worker *w = arg;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(w->index % (ncpus > 0 ? ncpus : 1), &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+        VLOG(WARNING, "Worker %d: cannot pin to a core", w->index);
     }
-    
-    // Write header for throughput data (CSV format)
-    fprintf(throughput_fp, "epoch time, bytes received, sequence number\n");
-    fflush(throughput_fp);
+    worker_run(w);
+    return NULL;
+}
+
+void on_signal(int sig) {
+    stop = 1;
+}
+
+// A bound UDP socket; with reuseport, one of a group the kernel load-balances across
+int open_socket(int portno, int reuseport) {
+    struct sockaddr_in serveraddr; /* server's addr */
+    int optval; /* flag value for setsockopt */
+    int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
 
-    // Create the parent socket
-    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd < 0) 
+    if (sockfd < 0)
         error("ERROR opening socket");
 
     //Allow the socket to be reused immediately after the program is killed
     optval = 1;
-    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, 
+    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR,
             (const void *)&optval , sizeof(int));
+    if (reuseport && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT,
+                                (const void *)&optval, sizeof(int)) < 0) {
+        error("SO_REUSEPORT");
+    }
+
+    // Give the kernel room to queue a whole sender burst between two recvmmsg
+    // calls; the request is silently capped at net.core.rmem_max
+    optval = RECV_SOCKET_BUFFER;
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF,
+            (const void *)&optval , sizeof(int));
+
+    if (server_mode) {
+        // Wake up now and then to sweep idle connections and notice a stop
+        set_recv_timeout(sockfd, REAP_INTERVAL_MS);
+    }
 
     // Build the server's Internet address
     bzero((char *) &serveraddr, sizeof(serveraddr));
@@ -143,91 +877,135 @@ int main(int argc, char **argv) {
     serveraddr.sin_port = htons((unsigned short)portno);
 
     //Bind the parent socket to a port
-    if (bind(sockfd, (struct sockaddr *) &serveraddr, 
-                sizeof(serveraddr)) < 0) 
+    if (bind(sockfd, (struct sockaddr *) &serveraddr,
+                sizeof(serveraddr)) < 0)
         error("ERROR on binding");
+    return sockfd;
+}
+
+int main(int argc, char **argv) {
+    int portno; /* port to listen on */
+    int opt;
+    int ring_size = WINDOW_SIZE;
+    int nworkers = 1;
+    unsigned long datagrams = 0, recv_calls = 0, acks = 0, ack_calls = 0;
+    unsigned long writes = 0, syncs = 0, acquires = 0, fallbacks = 0, uploads = 0;
+    unsigned long parity = 0, rebuilt = 0, corrupt = 0, mismatched = 0;
+
+    /*
+     * check command line arguments
+     */
+    while ((opt = getopt(argc, argv, "a:n:p:s:vw:")) != -1) {
+        switch (opt) {
+        case 'a':
+            ack_every = atoi(optarg);
+            break;
+        case 'n':
+            nworkers = atoi(optarg);
+            server_mode = 1;
+            break;
+        case 'p':
+            prealloc = atoll(optarg);
+            break;
+        case 's':
+            sync_interval_ms = atoi(optarg);
+            break;
+        case 'v':
+            verbose = ALL;
+            break;
+        case 'w':
+            ring_size = atoi(optarg);
+            break;
+        default:
+            argc = 0;  // force the usage message
+        }
+    }
+    if (argc - optind != 2 || ring_size <= 0 || ring_size > MAX_WINDOW_SIZE || nworkers <= 0 ||
+        nworkers > MAX_WORKERS) {
+        fprintf(stderr, "usage: %s [-a ack_every] [-n workers] [-p prealloc_bytes] [-s sync_ms] [-v] [-w window_segments] <port> FILE_RECVD\n", argv[0]);
+        fprintf(stderr, "  with -n, serve uploads until killed, each into FILE_RECVD.<conn_id>\n"
+                "  (the stripes of an rdt_sender -P transfer share one)\n"
+                "  -v logs every datagram to stderr\n"
+                "  -w is at most %d segments\n", MAX_WINDOW_SIZE);
+        exit(1);
+    }
+    portno = atoi(argv[optind]);
+    out_path = argv[optind + 1];
+    stats_open(&stats, STATS_RECEIVER, nworkers, nworkers * STATS_SLOTS_PER_WORKER, NULL);
 
     //Log the header for throughput data
     VLOG(DEBUG, "epoch time, bytes received, sequence number");
 
-    clientlen = sizeof(clientaddr);
-    init_packet_buffer();  // Initialize the packet buffer
-    
-    while (1) {
-        // Receive a UDP datagram from a client
-        if (recvfrom(sockfd, buffer, MSS_SIZE, 0,
-                (struct sockaddr *) &clientaddr, (socklen_t *)&clientlen) < 0) {
-            error("ERROR in recvfrom");
-        }
-        
-        recvpkt = (tcp_packet *) buffer;
-        assert(get_data_size(recvpkt) <= DATA_SIZE);
-        
-        // Check if this is the EOF packet
-        if (recvpkt->hdr.data_size == 0) {
-            VLOG(INFO, "End Of File has been reached");
-            fclose(fp);
-            fclose(throughput_fp); // Close throughput data file
-            break;
+    init_packet_buffer(ring_size);  // Size the reassembly rings
+    fec_init();
+    crc32c_init();
+    if (!server_mode) {
+        // One transfer, on this thread, until its EOF
+        workers[0].sockfd = open_socket(portno, 0);
+        worker_run(&workers[0]);
+    } else {
+        struct sigaction sa;
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_signal;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+
+        for (int i = 0; i < nworkers; i++) {
+            workers[i].index = i;
+            workers[i].sockfd = open_socket(portno, 1);
         }
-        
-        gettimeofday(&tp, NULL);
-        
-        // Log throughput data to both console and file
-        VLOG(DEBUG, "%lu, %d, %d", tp.tv_sec, recvpkt->hdr.data_size, recvpkt->hdr.seqno);
-        
-        // Write to throughput data file - no spaces after commas for plotting script compatibility
-        fprintf(throughput_fp, "%lu,%d,%d\n", tp.tv_sec, recvpkt->hdr.data_size, recvpkt->hdr.seqno);
-        fflush(throughput_fp);
-        
-        /*
-         * Check if the received packet is within our window
-         * We accept packets if:
-         * 1. seqno >= next_expected_seqno (not older than what we expect)
-         * 2. seqno < next_expected_seqno + window_size*DATA_SIZE (within our window)
-         */
-        if (recvpkt->hdr.seqno >= next_expected_seqno && 
-            recvpkt->hdr.seqno < next_expected_seqno + receiver_window_size * DATA_SIZE) {
-            
-            // Calculate the window index for this packet
-            int window_index = get_window_index(recvpkt->hdr.seqno);
-            
-            // If index is within the window size
-            if (window_index < WINDOW_SIZE) {
-                // Save the packet in our buffer if we haven't received it yet
-                if (!recv_buffer[window_index].received) {
-                    recv_buffer[window_index].packet = (tcp_packet *)malloc(TCP_HDR_SIZE + recvpkt->hdr.data_size);
-                    memcpy(recv_buffer[window_index].packet, recvpkt, TCP_HDR_SIZE + recvpkt->hdr.data_size);
-                    recv_buffer[window_index].received = 1;
-                    VLOG(DEBUG, "Stored packet with seqno %d at window index %d, data_size: %d", 
-                         recvpkt->hdr.seqno, window_index, recvpkt->hdr.data_size);
-                    
-                    // If this is the next expected packet, write contiguous packets
-                    // Only advance when we get in-order packets
-                    if (window_index == 0) {
-                        write_contiguous_packets(fp);
-                    }
-                }
+        for (int i = 0; i < nworkers; i++) {
+            if (pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i]) != 0) {
+                error("pthread_create");
             }
         }
-        
-        //Send cumulative ACK back to the client
-        sndpkt = make_packet(0);
-        sndpkt->hdr.ackno = next_expected_seqno;
-        sndpkt->hdr.ctr_flags = ACK;
-        
-        if (sendto(sockfd, sndpkt, TCP_HDR_SIZE, 0, 
-                (struct sockaddr *) &clientaddr, clientlen) < 0) {
-            error("ERROR in sendto");
+        for (int i = 0; i < nworkers; i++) {
+            pthread_join(workers[i].thread, NULL);
         }
-        
-        free(sndpkt);
     }
-    
-    // Cleanup any remaining packets in the buffer
-    for (int i = 0; i < WINDOW_SIZE; i++) {
-        free_packet_buffer(i);
+
+    for (int i = 0; i < nworkers; i++) {
+        worker *w = &workers[i];
+
+        if (server_mode) {
+            VLOG(INFO, "Worker %d: %lu uploads completed of %lu, %lu datagrams",
+                 i, w->completed, w->accepted, w->rx_batch.datagrams);
+        }
+        datagrams += w->rx_batch.datagrams;
+        recv_calls += w->rx_batch.syscalls;
+        acks += w->ack_batch.datagrams;
+        ack_calls += w->ack_batch.syscalls;
+        writes += w->writes;
+        syncs += w->syncs;
+        parity += w->parity;
+        rebuilt += w->rebuilt;
+        corrupt += w->rx_batch.corrupt;
+        mismatched += w->mismatched;
+        acquires += w->pool_acquires;
+        fallbacks += w->pool_fallbacks;
+        uploads += w->completed;
+        close(w->sockfd);
+    }
+    if (server_mode) {
+        VLOG(INFO, "Completed %lu uploads", uploads);
+    }
+    VLOG(INFO, "Received %lu datagrams in %lu recvmmsg calls, sent %lu ACKs",
+         datagrams, recv_calls, acks);
+    VLOG(INFO, "Wrote output with %lu pwritev calls and %lu syncs", writes, syncs);
+    VLOG(INFO, "Syscalls: %lu recv, %lu send, %lu write",
+         recv_calls, ack_calls, writes + syncs);
+    if (parity > 0) {
+        VLOG(INFO, "Rebuilt %lu segments from %lu parity datagrams", rebuilt, parity);
+    }
+    if (corrupt > 0) {
+        VLOG(INFO, "Dropped %lu datagrams that failed their CRC32C", corrupt);
+    }
+    if (mismatched > 0) {
+        VLOG(WARNING, "Whole-file CRC32C mismatch in %lu transfers", mismatched);
     }
+    VLOG(INFO, "Packet pool: %lu acquires, %lu malloc fallbacks", acquires, fallbacks);
+    stats_close(&stats);
 
-    return 0;
+    return mismatched > 0;
 }
@@ -6,73 +6,261 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include <signal.h>
 #include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/prctl.h>
+#include <fcntl.h>
 #include <time.h>
 #include <assert.h>
+#include <errno.h>
 #include <math.h>  // for floor function
+#include <pthread.h>
+#include <sched.h>
 
 #include"packet.h"
 #include"common.h"
+#include"batch.h"
+#include"event.h"
+#include"window.h"
+#include"cc.h"
+#include"evlog.h"
+#include"stats.h"
+#include"fec.h"
+#include"crc32c.h"
 
 #define STDIN_FD    0
-#define INITIAL_RTO 3000 // 3 seconds in milliseconds
-#define MAX_RTO 240000   // 240 seconds in milliseconds
+#define INITIAL_RTO_US 1000000 // 1 second before the first RTT sample (RFC 6298)
+#define MAX_RTO_US 60000000    // backoff stops doubling at 60 seconds
+#define DEFAULT_MIN_RTO_MS 200 // RTO floor unless -m says otherwise
+#define RTO_GRANULARITY_US 1000 // least the variance term adds to SRTT (RFC 6298's G)
+#define EOF_RETRY_US 250000    // EOF resends at most this far apart, well within the receiver's linger
+#define EOF_MAX_TRIES 8        // EOF transmissions before giving up on its acknowledgement
+#define MAX_RTT_SAMPLE_US 60000000 // echoes older than this are stale (or mangled) and ignored
+#define DEFAULT_WINDOW 128 // Retransmission queue size in segments
+#define PACE_BURST_US 1000 // Sending time a paced sender may catch up on at once
+#define TXTIME_HORIZON_US 2000 // How far ahead segments are handed to an SO_TXTIME qdisc
+#define RTT_HIST_US 100    // RTT histogram bucket width
+#define RTT_HIST_BUCKETS 20000 // Covers 0-2 s; longer samples land in the last bucket
 
-// Congestion control states
-#define SLOW_START 0
-#define CONGESTION_AVOIDANCE 1
-#define FAST_RETRANSMIT 2
+// Scoreboard flags kept for every outstanding segment (RFC 6675 style)
+#define SEG_SACKED        0x1  // Receiver holds it out of order
+#define SEG_LOST          0x2  // Deemed lost, needs a retransmission
+#define SEG_RETRANSMITTED 0x4  // Retransmitted since it was last marked lost
+#define DUPTHRESH 3            // SACKed segments above a hole before it is deemed lost
+
+#define FEC_INITIAL_LOSS 0.01  // loss rate -F assumes until it has measured one
+#define FEC_LOSS_GAIN 0.125    // weight of each block's loss sample in the loss rate
+
+// Parity of one block as it goes out; the batch references the headers and
+// rows until it is flushed
+typedef struct {
+    tcp_header hdr[FEC_MAX_PARITY];
+    uint8_t row[FEC_MAX_PARITY][DATA_SIZE];
+} parity_set;
+
+struct sender_conn;
+
+/*
+ * A worker owns one socket, one event loop and the connections assigned to
+ * it, and runs them on its own thread (the main thread when there is only
+ * one). Workers share nothing on the data path: a connection's ACKs come
+ * back to the socket it sends from.
+ */
+typedef struct sender_worker {
+    int index;
+    int sockfd;
+    pthread_t thread;
+    
+    // Event loop: socket readiness and the per-connection timers are dispatched
+    // from one epoll/timerfd loop, so nothing runs in signal context
+    event_loop loop;
+    ev_io sock_io;
+    
+    // Transmit batching: new data goes out through data_batch, retransmissions
+    // through retx_batch. Both are shared by the worker's connections and
+    // flushed once per event, so one sendmmsg carries the segments of many
+    // transfers.
+    send_batch data_batch;
+    send_batch retx_batch;
+    
+    struct sender_conn **acked_conns;   // connections that got ACKs in the current drain
+    int nacked;
+    int active_conns;                   // its transfers that have not sent their EOF yet
+    
+    // RTT samples (one per ACK echoing a timestamp) for the end-of-run
+    // latency summary
+    unsigned long rtt_hist[RTT_HIST_BUCKETS];
+    unsigned long rtt_samples;
+    unsigned long timeouts;             // retransmission timer expiries
+    unsigned long ack_syscalls;         // recvfrom calls, including the one that drains the socket
+    stats_worker *st;                   // its counters as rdt_stat sees them
+} sender_worker;
+
+/*
+ * One transfer, or one stripe of one: all protocol state the sender keeps
+ * per connection. Any number of them run side by side off a worker's event
+ * loop and socket. Every datagram carries the connection's conn_id:
+ * conn_base plus the transfer's index shifted by stripe_shift, plus its
+ * stripe, so an ACK finds its connection without a lookup table.
+ */
+typedef struct sender_conn {
+    int conn_id;                 // tags this transfer's datagrams for the receiver
+    const char *path;            // file being sent
+    sender_worker *w;            // the worker that runs it
+    int stripe;                  // stripe number, -1 for an unstriped transfer
+    
+    // Window and sequence tracking variables
+    int next_seqno;              // Next sequence number to be sent
+    int send_base;               // Oldest unacknowledged sequence number
+    cc_ctx cc;                   // Congestion window and the algorithm that drives it
+    int dup_acks;                // Count of duplicate ACKs
+    int last_ack;                // Last ACK received
+    int packets_sent;            // Count of packets sent in current window
+    int pipe_segments;           // Segments believed to be in the network (sent, not SACKed, not lost)
+    int recovery_point;          // next_seqno when recovery started; recovery ends once it is ACKed
+    
+    // RTO estimation (RFC 6298, fed one timestamp sample per ACK as in
+    // RFC 7323 appendix G), all in microseconds
+    double srtt_us;              // Smoothed RTT, 0 until the first sample
+    double rttvar_us;            // RTT variation
+    int64_t rto_us;              // Current RTO, backoff included
+    int consecutive_timeouts;    // Count of consecutive timeouts for exponential backoff
+    
+    // Window management: header, send time and scoreboard flags (SEG_*) of every
+    // outstanding packet; payloads stay in the source
+    window *snd_window;
+    
+    // Zero-copy source: a regular file is memory-mapped and datagrams are gathered
+    // straight from the mapping, so segment seqno doubles as the file offset.
+    // Files that cannot be mapped (pipes, or -r) are read into stream_buf, one
+    // DATA_SIZE slot per window slot.
+    // A stripe sends the range of src_len bytes at file offset src_base,
+    // with seqnos counting from the start of the range.
+    FILE *fp;                    // File being read, NULL once it is mapped
+    char *src_map;               // Mapping of the whole input file
+    size_t map_len;              // Length of the mapping
+    off_t src_base;              // File offset seqno 0 is read from
+    size_t src_len;              // Bytes to send; unknown (SIZE_MAX) for an unstriped read() source
+    char *stream_buf;            // Payload slots used when the file is read instead
+    
+    // Delivery-rate sampling: bytes delivered (ACKed or SACKed) so far and when
+    // the last of them was; every transmission snapshots both into its entry
+    uint64_t delivered_bytes;
+    uint64_t delivered_us;
+    uint64_t first_sent_us;      // send time of the newest segment delivered so far
+    uint64_t rack_xmit_us;       // same, used to spot lost retransmissions
+    
+    // Pacing: segments leave no faster than the congestion control module's
+    // pacing rate, or cwnd/SRTT for modules without one (unless -U);
+    // pace_next_ns is when the next one may go. With -T the departure times are
+    // handed to the kernel (SO_TXTIME) up to TXTIME_HORIZON_US ahead instead.
+    ev_timer pace_timer;
+    uint64_t pace_next_ns;
+    
+    // Forward error correction (-F): new segments go out in blocks of fec_n,
+    // each followed by fec_k parity segments, fec_k chosen at the start of
+    // the block from loss_rate. A block is encoded as it is sent, into the
+    // next of nsets parity sets, so no set is reused while a batch still
+    // references it. parity_tsval[block % nblock_slots] is the timestamp of
+    // the block's parity, 0 until it has gone out: a hole in a block is not
+    // deemed lost by SACKs until the receiver has echoed that timestamp (or
+    // a later one), since until then the parity may still fill it.
+    int fec_k;
+    int fec_open;                // the current block's parity is still to be sent
+    parity_set *parity;
+    int nsets, set;
+    uint32_t *parity_tsval;
+    int nblock_slots;
+    uint32_t latest_echo;        // newest timestamp the receiver has echoed
+    double loss_rate;            // segments lost per new segment sent, averaged over blocks
+    unsigned long fec_sent;      // new segments sent
+    unsigned long fec_lost;      // segments deemed lost, plus those the receiver rebuilt
+    unsigned long sent_mark, lost_mark;  // the two at the last loss rate update
+    int rebuilt;                 // segments the receiver rebuilt, as of its newest ACK
+    unsigned long parity_sent;
+    uint32_t file_crc;           // CRC32C of the new data sent so far, carried by the EOF
+    
+    ev_timer rto_timer;
+    uint64_t start_us;           // when the transfer started
+    int acked;                   // queued on acked_conns by the ACK drain
+    int eof_sent;                // EOF transmissions so far; resent on the RTO until it is ACKed
+    int eof_acked;               // the receiver answered it, rather than the sender giving up
+    int done;                    // EOF acknowledged, resources released
+    stats_conn *st;              // live counters, published for rdt_stat
+} sender_conn;
 
 // Function prototypes
-void resend_packets(int sig);
-void start_timer();
-void stop_timer();
-void init_timer(int delay, void (*sig_handler)(int));
-void update_rtt(int measured_rtt_ms);
-void log_cwnd();
+void resend_packets(ev_timer *t, void *arg);
+void start_timer(sender_conn *c);
+void stop_timer(sender_conn *c);
+void update_rtt(sender_conn *c, int64_t rtt_us);
+void log_cwnd(sender_conn *c);
+void record_rtt(sender_worker *w, int64_t rtt_us);
+double rtt_percentile(double p);
 long get_current_time_ms();
-int is_window_full();
-int get_window_index(int seqno);
-void init_window_buffer(int size);
-void free_window_buffer(int index);
-void resize_window_buffer();
-void store_packet(tcp_packet *pkt, int index, int size);
-
-// Window and sequence tracking variables
-int next_seqno=0;                // Next sequence number to be sent
-int send_base=0;                 // Oldest unacknowledged sequence number
-float cwnd = 1.0;                // Congestion window size (in packets)
-int ssthresh = 64;               // Slow start threshold (in packets)
-int cc_state = SLOW_START;       // Current congestion control state
-int dup_acks = 0;                // Count of duplicate ACKs
-int last_ack = 0;                // Last ACK received
-int packets_sent = 0;            // Count of packets sent in current window
-
-// RTT estimation variables (RFC 6298)
-int rtt_measured = 0;            // Whether we've measured an RTT sample
-float estimated_rtt = 0;         // Estimated RTT
-float dev_rtt = 0;               // Deviation RTT
-int rto = INITIAL_RTO;           // Current RTO value in milliseconds
-int consecutive_timeouts = 0;    // Count of consecutive timeouts for exponential backoff
-struct timeval send_time;        // Time when packet was sent
-
-// Window management
-tcp_packet **window_buffer;      // Buffer to store sent packets for retransmission
-int *packet_sent_time;           // Time when each packet was sent
-int *packet_size;                // Size of each packet
-int window_size;                 // Current maximum window size
-
-// CWND tracking file
-FILE *cwnd_file = NULL;
+int is_window_full(sender_conn *c);
+int get_window_index(sender_conn *c, int seqno);
+void init_window_buffer(sender_conn *c, int size);
+void open_source(sender_conn *c, const char *path, int use_read);
+void handle_ack(sender_conn *c, tcp_packet *ack);
+int mark_sacked(sender_conn *c, sack_block *blocks, int nblocks, window_entry *newest);
+void segment_sent(sender_conn *c, window_entry *e);
+void segment_delivered(sender_conn *c, window_entry *e, window_entry *newest);
+int pace_allows(sender_conn *c);
+void pace_sent(sender_conn *c, send_batch *b, int len);
+void on_pace_timer(ev_timer *t, void *arg);
+int detect_lost_segments(sender_conn *c);
+void mark_lost(sender_conn *c, window_entry *e);
+int retransmit_lost(sender_conn *c, int limit);
+void enter_recovery(sender_conn *c);
+void fec_start_block(sender_conn *c);
+void fec_add_segment(sender_conn *c, window_entry *e);
+void send_parity(sender_conn *c);
+int fec_pending(sender_conn *c, window_entry *e);
+void fill_window(sender_conn *c);
+void flush_batches(sender_worker *w);
+void send_eof(sender_conn *c);
+void finish_transfer(sender_conn *c);
+void open_connection(sender_conn *c, sender_worker *w, const char *path, int id, int stripe);
+void init_worker(sender_worker *w, int index, int batch_size, int use_gso);
+void worker_run(sender_worker *w);
+void *worker_thread(void *arg);
+void on_socket_readable(int fd, uint32_t events, void *arg);
+
+// Every connection this process runs, stripes of a transfer side by side
+sender_conn *conns;
+int nconns = 0;
+int conn_base;
+int nstripes = 1;                // -P: connections (and workers) per transfer
+int stripe_shift = 0;            // conn_id bits a transfer's stripes are numbered in
+
+sender_worker *workers;
+int nworkers = 1;
+
+// Per-connection settings from the command line
+int window_segments = DEFAULT_WINDOW;
+const char *cc_name = NULL;      // congestion control module, NULL for the default
+double cc_knob = 0;              // its tunable, 0 for the module's default
+int pace_window = 1;             // pace modules without a rate of their own at cwnd/SRTT
+int use_read = 0;                // read the files instead of memory-mapping them
+int use_txtime = 0;
+int64_t min_rto_us = DEFAULT_MIN_RTO_MS * 1000;  // -m: RTO floor
+int fec_n = 0;                   // -F: data segments per FEC block, 0 for no FEC
+int fec_fixed_k = -1;            // -F n:k: parity segments per block, -1 to follow the loss rate
+
+// CWND trace of the first connection (CWND.evlog; evlog.py makes CWND.csv of it)
+evlog cwnd_log;
+stats_region stats;              // live metrics, one slot per connection, for rdt_stat
 struct timeval start_time;       // Program start time
+uint64_t start_us;               // the same, on the now_us() clock
 
-int sockfd, serverlen;
 struct sockaddr_in serveraddr;
-struct itimerval timer; 
-tcp_packet *sndpkt;
-tcp_packet *recvpkt;
-sigset_t sigmask;       
+
+// RTT histogram of every worker, merged once they are done
+unsigned long rtt_hist[RTT_HIST_BUCKETS];
+unsigned long rtt_samples = 0;
 
 // Get current time in milliseconds since program start
 long get_current_time_ms() {
@@ -82,252 +270,1141 @@ long get_current_time_ms() {
            (now.tv_usec - start_time.tv_usec) / 1000;
 }
 
-// Log CWND changes to file for visualization and analysis
-void log_cwnd() {
-    if (cwnd_file) {
-        fprintf(cwnd_file, "%ld,%f\n", get_current_time_ms(), cwnd);
-        fflush(cwnd_file);
+// Count an RTT sample in the worker's histogram; the last bucket takes the outliers
+void record_rtt(sender_worker *w, int64_t rtt_us) {
+    int64_t bucket = rtt_us / RTT_HIST_US;
+    
+    if (bucket >= RTT_HIST_BUCKETS) {
+        bucket = RTT_HIST_BUCKETS - 1;
+    }
+    w->rtt_hist[bucket]++;
+    w->rtt_samples++;
+}
+
+// The RTT in microseconds below which a fraction p of the samples fall
+// (to the bucket's upper edge), 0 without samples
+double rtt_percentile(double p) {
+    unsigned long seen = 0;
+    
+    for (int i = 0; i < RTT_HIST_BUCKETS && rtt_samples > 0; i++) {
+        seen += rtt_hist[i];
+        if (seen >= p * rtt_samples) {
+            return (i + 1) * (double)RTT_HIST_US;
+        }
+    }
+    return 0;
+}
+
+// Publish a connection's window and congestion control state (and the time
+// spent in the state it leaves) for rdt_stat, and trace the first
+// connection's window; only worker 0 ever logs to cwnd_log
+void log_cwnd(sender_conn *c) {
+    stats_sender_conn *st = &c->st->s;
+    
+    st->cwnd = c->cc.cwnd;
+    st->ssthresh = c->cc.ssthresh;
+    st->pipe = c->pipe_segments;
+    if (c->cc.state != st->cc_state) {
+        uint64_t now = now_us();
+        
+        st->state_us[st->cc_state] += now - st->state_since_us;
+        st->state_since_us = now;
+        st->cc_state = c->cc.state;
+    }
+    if (c == conns) {
+        evlog_record r = {.type = EVLOG_CWND, .conn_id = c->conn_id, .time = now_us() - start_us,
+                          .arg = c->cc.ssthresh, .value = c->cc.cwnd};
+        
+        evlog_put(&cwnd_log, &r);
     }
 }
 
 // Function to check if window is full (we've sent as many packets as allowed by cwnd)
-int is_window_full() {
-    return packets_sent >= (int)floor(cwnd);
+// SACKed and lost segments have left the network, so they do not count against cwnd,
+// but every outstanding segment needs a slot in the window buffer
+int is_window_full(sender_conn *c) {
+    return c->pipe_segments >= (int)floor(c->cc.cwnd) || buffer_full(c->snd_window) == 1;
 }
 
-// Function to get window index for a sequence number
-// Using fixed window size to prevent buffer indexing issues when cwnd changes
-int get_window_index(int seqno) {
-    // Use fixed window size instead of variable cwnd for index calculation
-    // This prevents issues with changing cwnd values affecting buffer indexing
-    return (seqno / DATA_SIZE) % window_size;
+// Function to get the stream_buf slot for a sequence number; it matches the
+// segment's slot in snd_window
+int get_window_index(sender_conn *c, int seqno) {
+    return (seqno / DATA_SIZE) & c->snd_window->mask;
 }
 
 // Initialize the window buffer to store packets for potential retransmission
-void init_window_buffer(int size) {
-    window_size = size;
-    window_buffer = (tcp_packet **)malloc(size * sizeof(tcp_packet *));
-    packet_sent_time = (int *)malloc(size * sizeof(int));
-    packet_size = (int *)malloc(size * sizeof(int));
+void init_window_buffer(sender_conn *c, int size) {
+    c->snd_window = set_window(size);
+    if (c->snd_window == NULL) {
+        error("set_window");
+    }
     
-    for (int i = 0; i < size; i++) {
-        window_buffer[i] = NULL;
-        packet_sent_time[i] = 0;
-        packet_size[i] = 0;
+    // Only a read() source needs room for payloads
+    if (c->src_map == NULL) {
+        c->stream_buf = (char *)malloc((size_t)c->snd_window->window_size * DATA_SIZE);
     }
 }
 
-// Function to free window buffer at a specific index
-void free_window_buffer(int index) {
-    // Add bounds checking
-    if (index < 0 || index >= window_size) {
-        VLOG(INFO, "Invalid window index %d (window size: %d)", index, window_size);
+/*
+ * open_source: memory-map the input file, or fall back to buffered reads
+ * when it cannot be mapped (not a regular file, empty, or use_read is set).
+ * A stripe then narrows the source down to its range of the file.
+ */
+void open_source(sender_conn *c, const char *path, int use_read) {
+    struct stat st;
+    
+    c->fp = fopen(path, "r");
+    if (c->fp == NULL) {
+        error((char *)path);
+    }
+    c->src_len = SIZE_MAX;
+    if (fstat(fileno(c->fp), &st) < 0 || !S_ISREG(st.st_mode)) {
+        if (c->stripe >= 0) {
+            fprintf(stderr, "ERROR, %s: only a regular file can be striped\n", path);
+            exit(1);
+        }
+        return;
+    }
+    if (st.st_size > MAX_FILE_SIZE) {
+        fprintf(stderr, "ERROR, %s: larger than the %d bytes a transfer can hold\n", path, MAX_FILE_SIZE);
+        exit(1);
+    }
+    if (c->stripe >= 0) {
+        // Equal ranges on segment boundaries; the last one may be short, or empty
+        size_t range = ((st.st_size + nstripes - 1) / nstripes + DATA_SIZE - 1) / DATA_SIZE * DATA_SIZE;
+        
+        c->src_base = range * c->stripe < (size_t)st.st_size ? range * c->stripe : st.st_size;
+        c->src_len = st.st_size - c->src_base < range ? st.st_size - c->src_base : range;
+        fseeko(c->fp, c->src_base, SEEK_SET);
+    }
+    if (use_read || st.st_size == 0) {
         return;
     }
     
-    if (window_buffer[index] != NULL) {
-        free(window_buffer[index]);
-        window_buffer[index] = NULL;
-        packet_sent_time[index] = 0;
-        packet_size[index] = 0;
+    c->src_map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(c->fp), 0);
+    if (c->src_map == MAP_FAILED) {
+        VLOG(WARNING, "mmap of %s failed, reading it instead", path);
+        c->src_map = NULL;
+        return;
+    }
+    c->map_len = st.st_size;
+    if (c->stripe < 0) {
+        c->src_len = st.st_size;
     }
+    madvise(c->src_map, c->map_len, MADV_SEQUENTIAL);
+    // The mapping outlives the descriptor; thousands of transfers need not hold one each
+    fclose(c->fp);
+    c->fp = NULL;
 }
 
-// Resize window buffer if needed to accommodate growing congestion window
-void resize_window_buffer() {
-    int new_size = (int)ceil(cwnd) * 2;  // Double the size for safety
-    if (new_size > window_size) {
-        tcp_packet **new_buffer = (tcp_packet **)malloc(new_size * sizeof(tcp_packet *));
-        int *new_sent_time = (int *)malloc(new_size * sizeof(int));
-        int *new_packet_size = (int *)malloc(new_size * sizeof(int));
-        
-        // Copy existing data
-        for (int i = 0; i < window_size; i++) {
-            new_buffer[i] = window_buffer[i];
-            new_sent_time[i] = packet_sent_time[i];
-            new_packet_size[i] = packet_size[i];
+// Start (or restart) the retransmission timer with the current RTO
+void start_timer(sender_conn *c)
+{
+    ev_timer_start(&c->w->loop, &c->rto_timer, c->rto_us);
+}
+
+// Stop the retransmission timer
+void stop_timer(sender_conn *c)
+{
+    ev_timer_stop(&c->w->loop, &c->rto_timer);
+}
+
+/*
+ * resend_packets: retransmission timer callback
+ * Runs from the event loop, so it may freely touch sender state and send
+ */
+void resend_packets(ev_timer *t, void *arg)
+{
+    sender_conn *c = arg;
+    
+    // Every segment is acknowledged and only the EOF is outstanding; it is
+    // a single datagram, resent without backoff
+    if (c->eof_sent > 0) {
+        if (c->eof_sent >= EOF_MAX_TRIES) {
+            VLOG(WARNING, "Transfer %08x: EOF not acknowledged after %d tries", c->conn_id, c->eof_sent);
+            finish_transfer(c);
+        } else {
+            send_eof(c);
         }
+        return;
+    }
+    
+    // Timeout occurred
+    VLOG(INFO, "Timeout happened on %08x", c->conn_id);
+    
+    // Implement exponential backoff; the next RTT sample undoes it
+    c->consecutive_timeouts++;
+    c->w->timeouts++;
+    c->st->s.timeouts++;
+    c->rto_us = c->rto_us * 2; // Double RTO for each consecutive timeout
+    if (c->rto_us > MAX_RTO_US) {
+        c->rto_us = MAX_RTO_US;
+    }
+    
+    // Keep firing every RTO until an ACK restarts the timer
+    start_timer(c);
+    
+    // Congestion control actions on timeout
+    cc_on_timeout(&c->cc, now_us());
+    log_cwnd(c);
+    
+    VLOG(DEBUG, "Timeout: CWND = %.2f, ssthresh = %d", c->cc.cwnd, c->cc.ssthresh);
+    
+    // Everything the receiver has not SACKed is presumed lost (RFC 6675 section 5.1);
+    // the holes are then refilled by fill_window as cwnd reopens
+    c->cc.in_recovery = 0;
+    c->pipe_segments = 0;
+    for (int seq = c->send_base; seq < c->next_seqno; seq += DATA_SIZE) {
+        window_entry *e = find_packet(c->snd_window, seq);
+        if (e != NULL && !(e->state & SEG_SACKED)) {
+            e->state = SEG_LOST;
+        }
+    }
+    
+    // Retransmit the lost packet (first unacknowledged packet)
+    if (retransmit_lost(c, 1) > 0) {
+        VLOG(DEBUG, "Resending packet %d to %s (timeout)", 
+            c->send_base, inet_ntoa(serveraddr.sin_addr));
+    }
+    flush_batches(c->w);
+}
+
+// Mark an outstanding segment as lost, taking it out of the pipe
+void mark_lost(sender_conn *c, window_entry *e) {
+    if (e == NULL) {
+        return;
+    }
+    int state = e->state;
+    
+    if (state & SEG_SACKED || (state & SEG_LOST && !(state & SEG_RETRANSMITTED))) {
+        return;  // Already out of the pipe
+    }
+    e->state = SEG_LOST;
+    c->pipe_segments--;
+    c->fec_lost++;
+}
+
+// Record the ranges the receiver reports holding beyond the cumulative ACK
+// Returns the number of segments newly SACKed
+int mark_sacked(sender_conn *c, sack_block *blocks, int nblocks, window_entry *newest) {
+    int sacked = 0;
+    
+    for (int b = 0; b < nblocks; b++) {
+        int start = blocks[b].start > c->send_base ? blocks[b].start : c->send_base;
+        start -= start % DATA_SIZE;  // segments start on DATA_SIZE boundaries
         
-        // Initialize new slots
-        for (int i = window_size; i < new_size; i++) {
-            new_buffer[i] = NULL;
-            new_sent_time[i] = 0;
-            new_packet_size[i] = 0;
+        for (int seq = start; seq < blocks[b].end && seq < c->next_seqno; seq += DATA_SIZE) {
+            window_entry *e = find_packet(c->snd_window, seq);
+            
+            if (e == NULL || e->state & SEG_SACKED ||
+                seq < blocks[b].start || seq + e->hdr.data_size > blocks[b].end) {
+                continue;
+            }
+            // A lost segment only occupies the pipe again once retransmitted
+            if (!(e->state & SEG_LOST) || e->state & SEG_RETRANSMITTED) {
+                c->pipe_segments--;
+            }
+            segment_delivered(c, e, newest);
+            e->state = SEG_SACKED;
+            sacked++;
         }
+    }
+    return sacked;
+}
+
+// Stamp a segment as it leaves with its timestamp and the delivery-rate
+// snapshot; the batch sends the header from the entry, so the stamp goes out
+void segment_sent(sender_conn *c, window_entry *e) {
+    uint64_t now = now_us();
+    
+    e->hdr.tsval = (uint32_t)now != 0 ? (uint32_t)now : 1;
+    if (c->pipe_segments == 0) {
+        // Nothing in flight: the interval starts now, not at the last delivery
+        c->delivered_us = now;
+        c->first_sent_us = now;
+    }
+    e->sent_us = now;
+    c->cc.prr_out++;
+    e->delivered = c->delivered_bytes;
+    e->delivered_us = c->delivered_us;
+    e->first_sent_us = c->first_sent_us;
+    packet_seal(&e->hdr, e->crc);  // the header is final for this transmission
+}
+
+// Count a newly ACKed or SACKed segment, remembering in newest the most
+// recently sent of them; its snapshot gives this ACK's rate and RTT sample
+void segment_delivered(sender_conn *c, window_entry *e, window_entry *newest) {
+    c->delivered_bytes += e->hdr.data_size;
+    c->delivered_us = now_us();
+    if (newest->sent_us == 0 || e->delivered >= newest->delivered) {
+        *newest = *e;
+    }
+}
+
+/*
+ * Scoreboard loss detection: an un-SACKed segment with at least DUPTHRESH
+ * SACKed segments above it is deemed lost (RFC 6675 IsLost). A retransmission
+ * is deemed lost too once a segment sent more than a quarter min RTT after it
+ * has been delivered (as in RACK); otherwise a lost retransmission would sit
+ * there until a partial ACK or the RTO. With FEC a hole waits until its
+ * block's parity has had its chance (fec_pending). Returns the number of
+ * segments newly marked lost.
+ */
+int detect_lost_segments(sender_conn *c) {
+    int sacked_above = 0;
+    int newly_lost = 0;
+    int last_seq = ((c->next_seqno - 1) / DATA_SIZE) * DATA_SIZE;
+    
+    for (int seq = last_seq; seq >= c->send_base; seq -= DATA_SIZE) {
+        window_entry *e = find_packet(c->snd_window, seq);
         
-        // Free old arrays and update pointers
-        free(window_buffer);
-        free(packet_sent_time);
-        free(packet_size);
+        if (e == NULL) {
+            continue;
+        }
+        if (e->state & SEG_SACKED) {
+            sacked_above++;
+        } else if (sacked_above >= DUPTHRESH && !(e->state & SEG_LOST) && !fec_pending(c, e)) {
+            mark_lost(c, e);
+            newly_lost++;
+        } else if (e->state & SEG_RETRANSMITTED && c->cc.min_rtt_us > 0 &&
+                   e->sent_us + c->cc.min_rtt_us / 4 < c->rack_xmit_us) {
+            mark_lost(c, e);
+            newly_lost++;
+        }
+    }
+    return newly_lost;
+}
+
+/*
+ * Retransmit up to limit (-1 = all) segments that are marked lost and not yet
+ * retransmitted, lowest sequence number first, onto retx_batch. A paced sender
+ * stops where the pacer does; fill_window picks up the rest. Returns how
+ * many went out.
+ */
+int retransmit_lost(sender_conn *c, int limit) {
+    int sent = 0;
+    
+    for (int seq = c->send_base; seq < c->next_seqno && (limit < 0 || sent < limit); seq += DATA_SIZE) {
+        window_entry *e = find_packet(c->snd_window, seq);
         
-        window_buffer = new_buffer;
-        packet_sent_time = new_sent_time;
-        packet_size = new_packet_size;
-        window_size = new_size;
+        if (e == NULL || e->state != SEG_LOST) {
+            continue;
+        }
+        if (!pace_allows(c)) {
+            break;
+        }
+        pace_sent(c, &c->w->retx_batch, e->hdr.data_size);
+        // In recovery the holes were found by SACK; otherwise the RTO declared them lost
+        if (c->cc.in_recovery) {
+            c->st->s.retx_fast++;
+        } else {
+            c->st->s.retx_timeout++;
+        }
+        c->st->s.segments_sent++;
+        c->st->s.bytes_sent += e->hdr.data_size;
+        batch_add_segment(&c->w->retx_batch, &e->hdr, TCP_HDR_SIZE,
+                          e->payload, e->hdr.data_size);
+        segment_sent(c, e);
+        e->state |= SEG_RETRANSMITTED;
+        c->pipe_segments++;
+        sent++;
+        VLOG(DEBUG, "Resending packet %d with %d bytes", seq, e->hdr.data_size);
     }
+    return sent;
 }
 
-// Store a packet in the window buffer for potential retransmission
-void store_packet(tcp_packet *pkt, int index, int size) {
-    if (index >= window_size) {
-        resize_window_buffer();
+// Start SACK loss recovery: mark every known hole lost; fill_window repairs
+// them, lowest first, as fast as the recovery window allows
+void enter_recovery(sender_conn *c) {
+    VLOG(INFO, "Fast retransmit triggered");
+    
+    // Congestion control actions
+    cc_on_loss(&c->cc, c->packets_sent, now_us());
+    log_cwnd(c);
+    
+    VLOG(DEBUG, "Fast retransmit: CWND = %.2f, ssthresh = %d", c->cc.cwnd, c->cc.ssthresh);
+    
+    c->cc.in_recovery = 1;
+    c->recovery_point = c->next_seqno;
+    
+    // The segment at send_base is the hole the duplicate ACKs point at
+    if (!fec_pending(c, return_packet_of_smallest_seqno(c->snd_window))) {
+        mark_lost(c, return_packet_of_smallest_seqno(c->snd_window));
     }
+    detect_lost_segments(c);
     
-    free_window_buffer(index);
+    // Reset duplicate ACK count
+    c->dup_acks = 0;
     
-    window_buffer[index] = (tcp_packet *)malloc(TCP_HDR_SIZE + size);
-    memcpy(window_buffer[index], pkt, TCP_HDR_SIZE + size);
-    packet_size[index] = size;
-    packet_sent_time[index] = get_current_time_ms();
+    // Restart timer
+    start_timer(c);
 }
 
-// Start the retransmission timer
-void start_timer()
-{
-    sigprocmask(SIG_UNBLOCK, &sigmask, NULL);
-    setitimer(ITIMER_REAL, &timer, NULL);
+/*
+ * Start the FEC block of the segment about to be sent: fold the loss seen
+ * since the last block into loss_rate, pick the block's parity count from
+ * it, and take the next parity set
+ */
+void fec_start_block(sender_conn *c) {
+    int block = c->next_seqno / DATA_SIZE / fec_n;
+    
+    if (c->fec_sent > c->sent_mark) {
+        double sample = (double)(c->fec_lost - c->lost_mark) / (c->fec_sent - c->sent_mark);
+        
+        c->loss_rate += (sample - c->loss_rate) * FEC_LOSS_GAIN;
+        c->sent_mark = c->fec_sent;
+        c->lost_mark = c->fec_lost;
+    }
+    c->fec_k = fec_fixed_k >= 0 ? fec_fixed_k : fec_parity_for(c->loss_rate, fec_n, FEC_MAX_PARITY);
+    c->set = (c->set + 1) % c->nsets;
+    memset(c->parity[c->set].row, 0, (size_t)c->fec_k * DATA_SIZE);
+    c->parity_tsval[block % c->nblock_slots] = 0;
+    c->fec_open = 1;
+    c->st->s.fec_k = c->fec_k;
+    c->st->s.loss_rate = c->loss_rate;
 }
 
-// Stop the retransmission timer
-void stop_timer()
-{
-    sigprocmask(SIG_BLOCK, &sigmask, NULL);
+// Tag a new segment with its block and fold its payload into the block's parity
+void fec_add_segment(sender_conn *c, window_entry *e) {
+    int col = e->hdr.seqno / DATA_SIZE % fec_n;
+    
+    if (col == 0) {
+        fec_start_block(c);
+    }
+    e->hdr.ctr_flags |= FEC | FEC_FLAGS(fec_n, c->fec_k);
+    fec_encode(c->parity[c->set].row[0], DATA_SIZE, c->fec_k, col, e->payload, e->hdr.data_size);
+    c->fec_sent++;
 }
 
 /*
- * init_timer: Initialize timer
- * delay: delay in milliseconds
- * sig_handler: signal handler function for re-sending unACKed packets
+ * Queue the parity of the block that ends at next_seqno, after its last
+ * segment. It is paced but does not count against cwnd: it is at most
+ * fec_k / fec_n on top, and it is never retransmitted.
  */
-void init_timer(int delay, void (*sig_handler)(int)) 
-{
-    signal(SIGALRM, sig_handler);
-    timer.it_interval.tv_sec = delay / 1000;    // sets an interval of the timer
-    timer.it_interval.tv_usec = (delay % 1000) * 1000;  
-    timer.it_value.tv_sec = delay / 1000;       // sets an initial value
-    timer.it_value.tv_usec = (delay % 1000) * 1000;
+void send_parity(sender_conn *c) {
+    parity_set *ps = &c->parity[c->set];
+    int block = (c->next_seqno - 1) / DATA_SIZE / fec_n;
+    int start = block * fec_n * DATA_SIZE;
+    int len = c->next_seqno - start < DATA_SIZE ? c->next_seqno - start : DATA_SIZE;
+    // Stamped a microsecond late: an echo of the block's own segments, sent
+    // in the same instant, must not pass for the parity's (fec_pending)
+    uint32_t now = (uint32_t)now_us() + 1;
+    
+    if (now == 0) {
+        now = 1;
+    }
+    
+    for (int r = 0; r < c->fec_k; r++) {
+        tcp_header *hdr = &ps->hdr[r];
+        
+        memset(hdr, 0, sizeof(*hdr));
+        hdr->seqno = c->next_seqno;
+        hdr->data_size = len;
+        hdr->conn_id = c->conn_id;
+        hdr->ctr_flags = FEC_PARITY | FEC_FLAGS(fec_n, c->fec_k) | FEC_ROW_FLAG(r);
+        if (c->stripe >= 0) {
+            hdr->ctr_flags |= STRIPED;
+            hdr->ackno = c->src_base;
+        }
+        hdr->tsval = now;
+        packet_seal(hdr, crc32c(0, ps->row[r], len));
+        pace_sent(c, &c->w->data_batch, len);
+        batch_add_segment(&c->w->data_batch, hdr, TCP_HDR_SIZE, ps->row[r], len);
+    }
+    c->parity_tsval[block % c->nblock_slots] = c->fec_k > 0 ? now : 0;
+    c->parity_sent += c->fec_k;
+    c->st->s.parity_sent = c->parity_sent;
+    c->fec_open = 0;
+    VLOG(DEBUG, "Sent %d parity segments for block %d", c->fec_k, block);
+}
 
-    sigemptyset(&sigmask);
-    sigaddset(&sigmask, SIGALRM);
+// Whether e is a hole its block's parity may still fill at the receiver
+int fec_pending(sender_conn *c, window_entry *e) {
+    uint32_t tsval;
+    
+    if (e == NULL || !(e->hdr.ctr_flags & FEC) || FEC_K(e->hdr.ctr_flags) == 0) {
+        return 0;
+    }
+    tsval = c->parity_tsval[e->hdr.seqno / DATA_SIZE / fec_n % c->nblock_slots];
+    return tsval == 0 || (int32_t)(c->latest_echo - tsval) < 0;
 }
 
-void resend_packets(int sig)
+/*
+ * update_rtt: feed one RTT sample into the RTO estimator (RFC 6298). ACKs
+ * arrive many per round trip, so the gains are divided by the number of
+ * samples a flight is expected to give (RFC 7323 appendix G); otherwise
+ * SRTT would only remember the last few ACKs and RTTVAR would collapse.
+ */
+void update_rtt(sender_conn *c, int64_t rtt_us) {
+    double err;
+    int samples = (c->pipe_segments + 1) / 2;  // ACKs per flight, were every other segment ACKed
+    
+    if (samples < 1) {
+        samples = 1;
+    }
+    if (c->srtt_us == 0) {
+        // First measurement
+        c->srtt_us = rtt_us;
+        c->rttvar_us = rtt_us / 2.0;
+    } else {
+        // alpha = 1/8, beta = 1/4, each spread over the flight's samples
+        err = rtt_us - c->srtt_us;
+        c->rttvar_us += (fabs(err) - c->rttvar_us) / (4.0 * samples);
+        c->srtt_us += err / (8.0 * samples);
+    }
+    
+    // RTO = SRTT + max(G, K * RTTVAR) with K = 4, no lower than -m
+    c->rto_us = c->srtt_us + (4 * c->rttvar_us > RTO_GRANULARITY_US ? 4 * c->rttvar_us : RTO_GRANULARITY_US);
+    if (c->rto_us < min_rto_us) {
+        c->rto_us = min_rto_us;
+    }
+    if (c->rto_us > MAX_RTO_US) {
+        c->rto_us = MAX_RTO_US;
+    }
+    
+    VLOG(DEBUG, "RTT measured: %lld us, SRTT: %.0f us, RTTVAR: %.0f us, RTO: %lld us",
+         (long long)rtt_us, c->srtt_us, c->rttvar_us, (long long)c->rto_us);
+    
+    c->st->s.srtt_us = c->srtt_us;
+    c->st->s.rto_us = c->rto_us;
+    c->st->s.rtt_samples++;
+    stats_hist_add(c->st->s.rtt_hist, rtt_us);
+    
+    // Reset consecutive timeouts since we got an ACK
+    c->consecutive_timeouts = 0;
+    
+    // The new RTO takes effect the next time the timer is (re)started
+}
+
+/*
+ * handle_ack: process one ACK from the receiver
+ * Slides the window on new cumulative ACKs, updates the SACK scoreboard and
+ * runs loss recovery
+ */
+void handle_ack(sender_conn *c, tcp_packet *ack)
 {
-    if (sig == SIGALRM)
-    {
-        // Timeout occurred
-        VLOG(INFO, "Timeout happened");
+    sack_block *sack = NULL;
+    int nsack = get_sack_blocks(ack, &sack);
+    cc_sample rs = {.rtt_us = -1};
+    window_entry newest = {.sent_us = 0};
+    uint64_t now = now_us();
+    int dup = 0;
+    
+    VLOG(DEBUG, "Received ACK %d with %d SACK blocks", ack->hdr.ackno, nsack);
+    
+    // Every ACK echoing a timestamp gives an RTT sample, a retransmission's
+    // included: the echo says which transmission it answers (no Karn's rule)
+    if (ack->hdr.tsecr != 0) {
+        int64_t rtt_us = (uint32_t)((uint32_t)now - ack->hdr.tsecr);
         
-        // Implement exponential backoff
-        consecutive_timeouts++;
-        rto = rto * (1 << consecutive_timeouts); // Double RTO for each consecutive timeout
-        if (rto > MAX_RTO) {
-            rto = MAX_RTO;
+        if (rtt_us < MAX_RTT_SAMPLE_US) {
+            update_rtt(c, rtt_us);
+            record_rtt(c->w, rtt_us);
+            rs.rtt_us = rtt_us;
         }
+        if (c->latest_echo == 0 || (int32_t)(ack->hdr.tsecr - c->latest_echo) > 0) {
+            c->latest_echo = ack->hdr.tsecr;
+        }
+    }
+    
+    // Segments rebuilt from parity were lost all the same
+    if (fec_n > 0 && ack->hdr.seqno > c->rebuilt) {
+        c->fec_lost += ack->hdr.seqno - c->rebuilt;
+        c->rebuilt = ack->hdr.seqno;
+        c->st->s.rebuilt = c->rebuilt;
+    }
+    
+    // Check if this is a new ACK
+    if (ack->hdr.ackno > c->send_base) {
+        // New ACK received
         
-        // Update timer with new RTO
-        init_timer(rto, resend_packets);
-        
-        // Congestion control actions on timeout
-        ssthresh = (int)fmax(cwnd / 2, 2);
-        cwnd = 1.0;
-        cc_state = SLOW_START;
-        packets_sent = 0;
-        log_cwnd();
+        // Free acknowledged packets
+        while (c->send_base < ack->hdr.ackno) {
+            window_entry *e = find_packet(c->snd_window, c->send_base);
+            int state = e != NULL ? e->state : 0;
+            
+            // Calculate the size of this packet to increment send_base correctly
+            int pkt_size = DATA_SIZE; // Default if we don't know the size
+            if (e != NULL) {
+                pkt_size = e->hdr.data_size;
+            }
+            // SACKed and not-yet-retransmitted lost segments already left the pipe
+            if (!(state & SEG_SACKED) && (!(state & SEG_LOST) || state & SEG_RETRANSMITTED)) {
+                c->pipe_segments--;
+            }
+            if (e != NULL && !(state & SEG_SACKED)) {
+                segment_delivered(c, e, &newest);
+                rs.delivered_segments++;
+            }
+            remove_packet_from_buffer(c->snd_window, c->send_base);
+            c->send_base += pkt_size;
+            c->packets_sent--;
+            rs.acked_segments++;
+        }
         
-        VLOG(DEBUG, "Timeout: CWND = %.2f, ssthresh = %d", cwnd, ssthresh);
+        // Reset duplicate ACK count
+        c->dup_acks = 0;
+        c->last_ack = ack->hdr.ackno;
+        c->st->s.bytes_acked = c->send_base;
         
-        // Retransmit the lost packet (first unacknowledged packet)
-        int index = get_window_index(send_base);
-        if (window_buffer[index] != NULL) {
-            sndpkt = window_buffer[index];
-            if(sendto(sockfd, sndpkt, TCP_HDR_SIZE + packet_size[index], 0, 
-                    (const struct sockaddr *)&serveraddr, serverlen) < 0)
-            {
-                error("sendto");
+        if (c->cc.in_recovery) {
+            if (c->send_base >= c->recovery_point) {
+                cc_end_recovery(&c->cc);
+                VLOG(DEBUG, "Recovery complete at %d", c->send_base);
+            } else {
+                // Partial ACK: the new send_base is another hole (NewReno)
+                if (!fec_pending(c, return_packet_of_smallest_seqno(c->snd_window))) {
+                    mark_lost(c, return_packet_of_smallest_seqno(c->snd_window));
+                }
             }
+        }
+        
+        // Restart timer if there are still unacknowledged packets
+        if (c->packets_sent > 0) {
+            start_timer(c);
+        } else {
+            stop_timer(c); // All packets acknowledged
+        }
+    } else if (ack->hdr.ackno == c->last_ack) {
+        // Duplicate ACK
+        c->dup_acks++;
+        dup = 1;
+        c->st->s.dup_acks++;
+        VLOG(DEBUG, "Duplicate ACK %d received (%d)", ack->hdr.ackno, c->dup_acks);
+    }
+    
+    rs.delivered_segments += mark_sacked(c, sack, nsack, &newest);
+    
+    // Sample the delivery rate from the most recently sent segment delivered
+    if (rs.delivered_segments > 0 || rs.acked_segments > 0) {
+        if (newest.sent_us != 0) {
+            // The rate is measured over the longer of the send and ACK intervals,
+            // so a burst of ACKs (or SACK information arriving late, in one
+            // cumulative ACK) cannot report more than the path carried
+            int64_t send_elapsed = newest.sent_us - newest.first_sent_us;
             
-            VLOG(DEBUG, "Resending packet %d to %s with %d bytes (timeout)", 
-                send_base, inet_ntoa(serveraddr.sin_addr), packet_size[index]);
+            c->first_sent_us = newest.sent_us;
+            if (newest.sent_us > c->rack_xmit_us) {
+                c->rack_xmit_us = newest.sent_us;
+            }
+            rs.prior_delivered = newest.delivered;
+            rs.interval_us = now - newest.delivered_us;
+            if (send_elapsed > rs.interval_us) {
+                rs.interval_us = send_elapsed;
+            }
+            if (rs.interval_us > 0) {
+                rs.delivery_rate = (c->delivered_bytes - newest.delivered) * 1e6 / rs.interval_us;
+            }
         }
     }
+    
+    // Loss detection comes before the congestion control update, so that in
+    // recovery the window is sized against a pipe without the new losses
+    int newly_lost = detect_lost_segments(c);
+    
+    // Fast retransmit after 3 duplicate ACKs, or as soon as the scoreboard shows a hole;
+    // with FEC only the scoreboard, which knows which holes parity may fill
+    if (!c->cc.in_recovery && ((c->dup_acks >= DUPTHRESH && fec_n == 0) || newly_lost > 0) &&
+        c->packets_sent > 0) {
+        enter_recovery(c);
+    }
+    
+    // A duplicate ACK without new SACK information still means a segment
+    // left the network (the DeliveredData estimate of RFC 6937)
+    if (dup && rs.delivered_segments == 0 && c->cc.state == FAST_RETRANSMIT) {
+        rs.delivered_segments = 1;
+    }
+    
+    // Let the congestion control module update the window from this ACK
+    if (rs.delivered_segments > 0 || rs.acked_segments > 0) {
+        rs.delivered = c->delivered_bytes;
+        rs.in_flight = c->pipe_segments;
+        cc_on_ack(&c->cc, &rs, now);
+        
+        // Log CWND change
+        log_cwnd(c);
+    }
 }
-void update_rtt(int measured_rtt_ms) {
-    // Validate that RTT is positive and reasonable
-    if (measured_rtt_ms <= 0 || measured_rtt_ms > 60000) {
-        VLOG(INFO, "Invalid RTT measurement: %d ms, ignoring", measured_rtt_ms);
-        return;  // Skip invalid RTT measurements
+
+/*
+ * fill_window: send new data as allowed by the congestion window
+ * Every segment cwnd allows is queued; the caller's flush_batches sends them
+ */
+void fill_window(sender_conn *c)
+{
+    int len;
+    const char *payload;
+    window_entry *e;
+
+    // Lost segments go before any new data. Modules that keep their window
+    // through a loss (BBR, Copa) repair every known hole at once; otherwise
+    // cwnd, which PRR sets in recovery, limits the repairs as it does after a
+    // timeout
+    if (c->cc.in_recovery && c->cc.state != FAST_RETRANSMIT) {
+        retransmit_lost(c, -1);
+    } else if (!is_window_full(c)) {
+        retransmit_lost(c, (int)floor(c->cc.cwnd) - c->pipe_segments);
+    }
+
+    while (!is_window_full(c) && pace_allows(c)) {
+        int window_idx = get_window_index(c, c->next_seqno);
+        size_t left = c->src_len - c->next_seqno;
+        
+        if (c->src_map != NULL) {
+            payload = c->src_map + c->src_base + c->next_seqno;
+            len = left > DATA_SIZE ? DATA_SIZE : left;
+        } else {
+            payload = c->stream_buf + (size_t)window_idx * DATA_SIZE;
+            len = fread((char *)payload, 1, left > DATA_SIZE ? DATA_SIZE : left, c->fp);
+            if (len > 0 && (size_t)c->next_seqno + len > MAX_FILE_SIZE) {
+                fprintf(stderr, "ERROR, input longer than the %d bytes a transfer can hold\n", MAX_FILE_SIZE);
+                exit(1);
+            }
+        }
+        if (len <= 0) {
+            // End of file reached; a read() source only finds out here
+            if (c->fec_open) {
+                send_parity(c);
+            }
+            if (c->packets_sent == 0) {
+                // All packets have been acknowledged; the EOF goes out once
+                // here, then on every RTO until the receiver answers it
+                if (c->eof_sent == 0) {
+                    send_eof(c);
+                }
+                return;
+            }
+            break; // Wait for ACKs before sending EOF
+        }
+        
+        // Store the packet header in the window buffer; is_window_full
+        // guarantees it has room
+        e = add_packet_to_buffer(c->snd_window, c->next_seqno, payload, len);
+        e->hdr.conn_id = c->conn_id;
+        e->crc = crc32c(0, payload, len);
+        c->file_crc = crc32c_combine(c->file_crc, e->crc, len);
+        if (c->stripe >= 0) {
+            e->hdr.ctr_flags = STRIPED;
+            e->hdr.ackno = c->src_base;
+        }
+        if (fec_n > 0) {
+            fec_add_segment(c, e);
+        }
+        segment_sent(c, e);
+        
+        // Queue header + payload in place; the whole window goes out in one batch
+        VLOG(DEBUG, "Sending packet %d with %d bytes, CWND = %.2f", 
+             c->next_seqno, len, c->cc.cwnd);
+        pace_sent(c, &c->w->data_batch, len);
+        batch_add_segment(&c->w->data_batch, &e->hdr, TCP_HDR_SIZE, e->payload, len);
+        
+        // Start timer if this is the first packet in the window
+        if (c->packets_sent == 0) {
+            start_timer(c);
+        }
+        
+        // Update sequence number and packet count
+        c->next_seqno += len;
+        c->st->s.segments_sent++;
+        c->st->s.bytes_sent += len;
+        c->packets_sent++;
+        c->pipe_segments++;
+        
+        // A block's parity follows its last segment, or the file's
+        if (c->fec_open && (c->next_seqno / DATA_SIZE % fec_n == 0 || (size_t)c->next_seqno >= c->src_len)) {
+            send_parity(c);
+        }
     }
+}
+
+// Hand every queued segment, of whatever connection, to the kernel;
+// retransmissions first
+void flush_batches(sender_worker *w)
+{
+    batch_flush(&w->retx_batch);
+    batch_flush(&w->data_batch);
     
-    if (!rtt_measured) {
-        // First measurement
-        estimated_rtt = measured_rtt_ms;
-        dev_rtt = measured_rtt_ms / 2.0;
-        rtt_measured = 1;
-    } else {
-        // Update estimates (alpha = 0.125, beta = 0.25)
-        dev_rtt = (1 - 0.25) * dev_rtt + 0.25 * fabs(measured_rtt_ms - estimated_rtt);
-        estimated_rtt = (1 - 0.125) * estimated_rtt + 0.125 * measured_rtt_ms;
+    // Once per event, so rdt_stat can turn them into syscalls per second
+    w->st->send_syscalls = w->data_batch.syscalls + w->retx_batch.syscalls;
+    w->st->datagrams_sent = w->data_batch.datagrams + w->retx_batch.datagrams;
+    w->st->recv_syscalls = w->ack_syscalls;
+    w->st->loop_syscalls = w->loop.syscalls;
+}
+
+/*
+ * Whether the pacer lets another segment out now (with SO_TXTIME: whether
+ * its departure time is within the horizon). If not, the pace timer is
+ * armed for when it will, and resumes fill_window then.
+ */
+int pace_allows(sender_conn *c) {
+    double rate = cc_pacing_rate(&c->cc);
+    uint64_t now, horizon;
+    
+    if (rate <= 0) {
+        return 1;  // Not paced: purely ACK-clocked
+    }
+    now = now_ns();
+    horizon = use_txtime ? TXTIME_HORIZON_US * 1000 : 0;
+    // Idle time earns at most one burst worth of credit
+    if (c->pace_next_ns + PACE_BURST_US * 1000 < now) {
+        c->pace_next_ns = now - PACE_BURST_US * 1000;
+    }
+    if (c->pace_next_ns <= now + horizon) {
+        return 1;
+    }
+    if (!ev_timer_pending(&c->pace_timer)) {
+        ev_timer_start_at_ns(&c->w->loop, &c->pace_timer, c->pace_next_ns - horizon);
+    }
+    return 0;
+}
+
+// Charge a segment of len bytes, about to be queued on b, to the pacer;
+// with SO_TXTIME it is stamped with its departure time
+void pace_sent(sender_conn *c, send_batch *b, int len) {
+    double rate = cc_pacing_rate(&c->cc);
+    
+    if (rate <= 0) {
+        return;
+    }
+    if (b->txtime) {
+        uint64_t now = now_ns();
+        batch_set_txtime(b, c->pace_next_ns > now ? c->pace_next_ns : now);
     }
+    c->pace_next_ns += (uint64_t)(len * 1e9 / rate);
+}
+
+// The pacer allows more data out
+void on_pace_timer(ev_timer *t, void *arg) {
+    sender_conn *c = arg;
     
-    // Set RTO (K = 4)
-    rto = (int)(estimated_rtt + 4 * dev_rtt);
+    fill_window(c);
+    flush_batches(c->w);
+}
+
+// Send the EOF marker, with the CRC32C of the data, and time it like a
+// segment: the RTO resends it until the receiver answers with EOF_ACK
+void send_eof(sender_conn *c)
+{
+    sender_worker *w = c->w;
+    tcp_packet *sndpkt;
     
-    // Ensure minimum of 1 second (RFC 6298)
-    if (rto < 1000) {
-        rto = 1000;
+    if (c->eof_sent == 0) {
+        VLOG(INFO, "End Of File has been reached");
+    }
+    // After the block's parity, if it is still queued
+    flush_batches(w);
+    sndpkt = make_packet(0);
+    sndpkt->hdr.conn_id = c->conn_id;
+    if (c->stripe >= 0) {
+        sndpkt->hdr.ctr_flags = STRIPED;
+        sndpkt->hdr.ackno = c->src_base;
     }
+    sndpkt->hdr.tsecr = c->file_crc;
+    packet_seal(&sndpkt->hdr, 0);
+    // A full queue is a loss like any other; anything else would fail every retry too
+    if (sendto(w->sockfd, sndpkt, TCP_HDR_SIZE, 0,
+               (const struct sockaddr *)&serveraddr, sizeof(serveraddr)) < 0 &&
+        errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) {
+        VLOG(WARNING, "Transfer %08x: sending the EOF failed: %s", c->conn_id, strerror(errno));
+    }
+    free_packet(sndpkt);
+    c->eof_sent++;
+    ev_timer_start(&w->loop, &c->rto_timer, c->rto_us < EOF_RETRY_US ? c->rto_us : EOF_RETRY_US);
+}
+
+// The EOF is acknowledged (or given up on): release the connection; the
+// worker's event loop stops with its last one
+void finish_transfer(sender_conn *c)
+{
+    sender_worker *w = c->w;
+    double elapsed_s = (now_us() - c->start_us) / 1e6;
     
-    VLOG(DEBUG, "RTT measured: %d ms, Estimated RTT: %.2f ms, Dev RTT: %.2f ms, RTO: %d ms", 
-         measured_rtt_ms, estimated_rtt, dev_rtt, rto);
+    // Segments still queued point into the window and the mapping freed below
+    flush_batches(w);
+    VLOG(INFO, "Transfer %08x: %s, %d bytes at %lld in %.2f s, %.2f Mbit/s",
+         c->conn_id, c->path, c->send_base, (long long)c->src_base,
+         elapsed_s, c->send_base * 8.0 / elapsed_s / 1e6);
+    c->st->end_us = now_us();
+    c->st->state = STATS_DONE;
     
-    // Reset consecutive timeouts since we got an ACK
-    consecutive_timeouts = 0;
+    // Free window buffer
+    free_window(c->snd_window);
+    free(c->stream_buf);
+    free(c->parity);
+    free(c->parity_tsval);
+    cc_release(&c->cc);
+    if (c->src_map != NULL) {
+        munmap(c->src_map, c->map_len);
+    }
+    if (c->fp != NULL) {
+        fclose(c->fp);
+    }
+    stop_timer(c);
+    ev_timer_stop(&w->loop, &c->pace_timer);
+    c->done = 1;
+    if (--w->active_conns == 0) {
+        ev_stop(&w->loop);
+    }
+}
+
+/*
+ * on_socket_readable: drain every queued ACK, then refill the windows
+ * Handling all pending ACKs first lets each window reopen by several
+ * segments, and every connection that got ACKs goes out in one batch
+ */
+void on_socket_readable(int fd, uint32_t events, void *arg)
+{
+    sender_worker *w = arg;
+    char ack_buffer[MSS_SIZE];
+    tcp_packet *recvpkt = (tcp_packet *)ack_buffer;
+    ssize_t len;
+
+    while (w->ack_syscalls++, (len = recvfrom(fd, ack_buffer, MSS_SIZE, MSG_DONTWAIT, NULL, NULL)) > 0) {
+        unsigned int off = (unsigned int)recvpkt->hdr.conn_id - (unsigned int)conn_base;
+        unsigned int idx = (off >> stripe_shift) * nstripes + (off & ((1u << stripe_shift) - 1));
+        sender_conn *c;
+        
+        w->st->datagrams_received++;
+        if (len < (ssize_t)TCP_HDR_SIZE ||
+            !packet_intact(recvpkt, len, crc32c(0, recvpkt->data, len - TCP_HDR_SIZE))) {
+            w->st->corrupt++;
+            continue;
+        }
+        if ((off & ((1u << stripe_shift) - 1)) >= (unsigned int)nstripes ||
+            idx >= (unsigned int)nconns || conns[idx].w != w || conns[idx].done) {
+            continue;  // A stale ACK for an earlier or finished transfer
+        }
+        c = &conns[idx];
+        if (c->eof_sent > 0) {
+            // Everything else is acknowledged already
+            if (recvpkt->hdr.ctr_flags & EOF_ACK) {
+                c->eof_acked = 1;
+                finish_transfer(c);
+            }
+            continue;
+        }
+        handle_ack(c, recvpkt);
+        if (!c->acked) {
+            c->acked = 1;
+            w->acked_conns[w->nacked++] = c;
+        }
+    }
+    for (int i = 0; i < w->nacked; i++) {
+        w->acked_conns[i]->acked = 0;
+        if (!w->acked_conns[i]->done) {
+            fill_window(w->acked_conns[i]);
+        }
+    }
+    w->nacked = 0;
+    flush_batches(w);
+}
+
+/*
+ * Run a worker's connections until all of them are done: send their first
+ * windows, then let ACKs and timeouts drive the transfers
+ */
+void worker_run(sender_worker *w)
+{
+    for (int i = 0; i < nconns && !w->loop.stop; i++) {
+        if (conns[i].w == w) {
+            fill_window(&conns[i]);
+        }
+    }
+    flush_batches(w);
+    if (w->active_conns > 0) {
+        ev_run(&w->loop);
+    }
+}
+
+// With -P, every worker but the first runs on a thread of its own, pinned
+// to its own core
+void *worker_thread(void *arg)
+{
+    sender_worker *w = arg;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t cpus;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(w->index % (ncpus > 0 ? ncpus : 1), &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+        VLOG(WARNING, "Worker %d: cannot pin to a core", w->index);
+    }
+    worker_run(w);
+    return NULL;
+}
+
+/*
+ * Set up a worker: its socket (its own source port), event loop and batches
+ */
+void init_worker(sender_worker *w, int index, int batch_size, int use_gso)
+{
+    w->index = index;
+    w->st = &stats.workers[index];
+    w->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (w->sockfd < 0) 
+        error("ERROR opening socket");
+    
+    init_send_batch(&w->data_batch, w->sockfd, &serveraddr, sizeof(serveraddr), batch_size, use_gso);
+    init_send_batch(&w->retx_batch, w->sockfd, &serveraddr, sizeof(serveraddr), batch_size, 0);
+    if (use_txtime && (batch_enable_txtime(&w->data_batch) < 0 || batch_enable_txtime(&w->retx_batch) < 0)) {
+        VLOG(WARNING, "SO_TXTIME unavailable (%s), pacing in user space", strerror(errno));
+        w->data_batch.txtime = w->retx_batch.txtime = 0;
+        use_txtime = 0;
+    }
+    
+    // Every connection's timers share the worker's loop
+    ev_init(&w->loop);
+    ev_add_io(&w->loop, &w->sock_io, w->sockfd, EPOLLIN, on_socket_readable, w);
+    w->acked_conns = malloc(nconns * sizeof(sender_conn *));
+    if (w->acked_conns == NULL) {
+        error("malloc");
+    }
+}
+
+/*
+ * open_connection: set up transfer c of path; the transfer itself starts
+ * with its first fill_window
+ */
+void open_connection(sender_conn *c, sender_worker *w, const char *path, int id, int stripe)
+{
+    memset(c, 0, sizeof(*c));
+    c->conn_id = id;
+    c->path = path;
+    c->w = w;
+    c->stripe = stripe;
+    c->rto_us = INITIAL_RTO_US;
+    if (cc_init(&c->cc, cc_name, cc_knob) < 0) {
+        error("cc_init");
+    }
+    c->cc.pace_window = pace_window;
+    open_source(c, path, use_read);
+    init_window_buffer(c, window_segments);
+    ev_timer_init(&c->rto_timer, resend_packets, c);
+    ev_timer_init(&c->pace_timer, on_pace_timer, c);
+    c->start_us = now_us();
+    if (fec_n > 0) {
+        // A batch holds at most BATCH_MAX datagrams: the parity of at most
+        // BATCH_MAX / fec_n blocks, the block being encoded aside
+        c->nsets = BATCH_MAX / fec_n + 2;
+        c->parity = malloc(c->nsets * sizeof(parity_set));
+        // Outstanding segments span at most this many blocks
+        c->nblock_slots = c->snd_window->window_size / fec_n + 2;
+        c->parity_tsval = calloc(c->nblock_slots, sizeof(uint32_t));
+        if (c->parity == NULL || c->parity_tsval == NULL) {
+            error("malloc");
+        }
+        c->loss_rate = FEC_INITIAL_LOSS;
+    }
     
-    // Update timer with new RTO
-    init_timer(rto, resend_packets);
+    c->st = &stats.conns[c - conns];
+    c->st->conn_id = id;
+    c->st->worker = w->index;
+    c->st->start_us = c->start_us;
+    c->st->s.state_since_us = c->start_us;
+    c->st->s.cc_state = c->cc.state;
+    c->st->s.rto_us = c->rto_us;
+    c->st->state = STATS_ACTIVE;
+    w->active_conns++;
 }
 
 int main (int argc, char **argv)
 {
-    int portno, len;
+    int portno, opt;
     char *hostname;
-    char buffer[DATA_SIZE];
-    FILE *fp;
+    int batch_size = BATCH_MAX;  // datagrams per sendmmsg; 1 gives the per-packet path
+    int use_gso = 0;             // coalesce batches into UDP GSO super-datagrams
+    int copies = 1;              // concurrent transfers of every FILE
+    int nfiles, ntransfers;
+    unsigned long datagrams = 0, retransmitted = 0, timeouts = 0, send_calls = 0, recv_calls = 0, loop_calls = 0;
+    uint64_t total_bytes = 0;
+    unsigned long parity = 0, rebuilt = 0, corrupt = 0, unacked_eofs = 0;
+    cc_ctx probe;
 
     /* check command line arguments */
-    if (argc != 4) {
-        fprintf(stderr,"usage: %s <hostname> <port> <FILE>\n", argv[0]);
+    while ((opt = getopt(argc, argv, "b:c:F:gk:m:N:P:rTUvw:")) != -1) {
+        switch (opt) {
+        case 'b':
+            batch_size = atoi(optarg);
+            break;
+        case 'c':
+            cc_name = optarg;
+            break;
+        case 'F':
+            fec_n = atoi(optarg);
+            if (strchr(optarg, ':') != NULL) {
+                fec_fixed_k = atoi(strchr(optarg, ':') + 1);
+            }
+            break;
+        case 'g':
+            use_gso = 1;
+            break;
+        case 'k':
+            cc_knob = atof(optarg);
+            break;
+        case 'm':
+            min_rto_us = atof(optarg) * 1000;
+            break;
+        case 'N':
+            copies = atoi(optarg);
+            break;
+        case 'P':
+            nstripes = atoi(optarg);
+            break;
+        case 'r':
+            use_read = 1;
+            break;
+        case 'T':
+            use_txtime = 1;
+            break;
+        case 'U':
+            pace_window = 0;
+            break;
+        case 'v':
+            verbose = ALL;
+            break;
+        case 'w':
+            window_segments = atoi(optarg);
+            break;
+        default:
+            argc = 0;  // force the usage message
+        }
+    }
+    if (argc - optind < 3 || window_segments <= 0 || copies <= 0 || min_rto_us <= 0 ||
+        nstripes <= 0 || nstripes > MAX_STRIPES || fec_n < 0 || fec_n > FEC_MAX_DATA ||
+        fec_fixed_k > FEC_MAX_PARITY || cc_init(&probe, cc_name, cc_knob) < 0) {
+        fprintf(stderr,"usage: %s [-b batch_size] [-c %s] [-F n[:k]] [-g] [-k cc_knob] [-m min_rto_ms] [-N copies] [-P stripes] [-r] [-T] [-U] [-v] [-w window_segments] <hostname> <port> <FILE>...\n",
+                argv[0], cc_names());
+        fprintf(stderr, "  every FILE (-N times each) is a concurrent transfer; more than one needs rdt_receiver -n\n");
+        fprintf(stderr, "  -F follows every n new segments (n <= %d) with k parity segments (k <= %d),\n"
+                "     by default as many as the measured loss rate calls for\n", FEC_MAX_DATA, FEC_MAX_PARITY);
+        fprintf(stderr, "  -m sets the floor of the retransmission timeout (default %d ms)\n", DEFAULT_MIN_RTO_MS);
+        fprintf(stderr, "  -P splits every transfer into byte ranges sent by that many threads and ports; needs rdt_receiver -n\n");
+        fprintf(stderr, "  -v logs every datagram and ACK to stderr\n");
         exit(0);
     }
-    hostname = argv[1];
-    portno = atoi(argv[2]);
-    fp = fopen(argv[3], "r");
-    if (fp == NULL) {
-        error(argv[3]);
+    VLOG(INFO, "Congestion control: %s", probe.ops->name);
+    crc32c_init();
+    if (fec_n > 0) {
+        fec_init();
+        VLOG(INFO, "FEC: blocks of %d segments, %s kernel", fec_n, fec_kernel_name());
     }
+    cc_release(&probe);
+    hostname = argv[optind];
+    portno = atoi(argv[optind + 1]);
+    nfiles = argc - optind - 2;
+    ntransfers = nfiles * copies;
 
     // Open CWND tracking file
-    cwnd_file = fopen("CWND.csv", "w");
-    if (cwnd_file == NULL) {
-        error("Cannot open CWND.csv for writing");
+    if (evlog_open(&cwnd_log, "CWND.evlog") < 0) {
+        error("Cannot open CWND.evlog for writing");
     }
-    fprintf(cwnd_file, "time,cwnd\n"); // CSV header
     
     // Record start time
     gettimeofday(&start_time, NULL);
-    
-    // Log initial CWND
-    log_cwnd();
-
-    /* socket: create the socket */
-    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd < 0) 
-        error("ERROR opening socket");
+    start_us = now_us();
 
     /* initialize server server details */
     bzero((char *) &serveraddr, sizeof(serveraddr));
-    serverlen = sizeof(serveraddr);
 
     /* covert host into network byte order */
     if (inet_aton(hostname, &serveraddr.sin_addr) == 0) {
@@ -341,189 +1418,91 @@ int main (int argc, char **argv)
 
     assert(MSS_SIZE - TCP_HDR_SIZE > 0);
 
-    // Initialize window buffer
-    init_window_buffer(128);  // Start with a reasonable size
-    
-    // Initialize timer with initial RTO
-    init_timer(INITIAL_RTO, resend_packets);
-    
-    next_seqno = 0;
-    send_base = 0;
-    
-    while (1)
-    {
-        // Send data as allowed by congestion window
-        while (!is_window_full()) {
-            len = fread(buffer, 1, DATA_SIZE, fp);
-            if (len <= 0) {
-                // End of file reached
-                if (packets_sent == 0) {
-                    // All packets have been acknowledged, can exit
-                    VLOG(INFO, "End Of File has been reached");
-                    sndpkt = make_packet(0);
-                    sendto(sockfd, sndpkt, TCP_HDR_SIZE, 0,
-                           (const struct sockaddr *)&serveraddr, serverlen);
-                    free(sndpkt);
-                    fclose(cwnd_file); // Close CWND tracking file
-                    
-                    // Free window buffer
-                    for (int i = 0; i < window_size; i++) {
-                        free_window_buffer(i);
-                    }
-                    free(window_buffer);
-                    free(packet_sent_time);
-                    free(packet_size);
-                    
-                    return 0;
-                }
-                break; // Wait for ACKs before sending EOF
-            }
-            
-            // Create packet
-            sndpkt = make_packet(len);
-            memcpy(sndpkt->data, buffer, len);
-            sndpkt->hdr.seqno = next_seqno;
-            
-            // Store packet in window buffer
-            int window_idx = get_window_index(next_seqno);
-            store_packet(sndpkt, window_idx, len);
-            
-            // Send the packet
-            VLOG(DEBUG, "Sending packet %d with %d bytes, CWND = %.2f", 
-                 next_seqno, len, cwnd);
-            
-            if(sendto(sockfd, sndpkt, TCP_HDR_SIZE + len, 0, 
-                      (const struct sockaddr *)&serveraddr, serverlen) < 0) {
-                error("sendto");
-            }
-            
-            // Start timer if this is the first packet in the window
-            if (packets_sent == 0) {
-                start_timer();
-            }
-            
-            // Update sequence number and packet count
-            next_seqno += len;
-            packets_sent++;
+    // Pacing timers are due every few microseconds; the default 50 us
+    // timer slack would bunch them back into bursts
+    prctl(PR_SET_TIMERSLACK, 1UL);
+
+    // One connection per FILE, copy and stripe; stripe i of every transfer
+    // runs on worker i. A striped transfer's conn_ids differ only in the
+    // STRIPE_MASK bits, which the receiver groups them by.
+    nconns = ntransfers * nstripes;
+    nworkers = nstripes;
+    if (nstripes > 1) {
+        stripe_shift = STRIPE_BITS;
+    }
+    conns = calloc(nconns, sizeof(sender_conn));
+    workers = calloc(nworkers, sizeof(sender_worker));
+    if (conns == NULL || workers == NULL) {
+        error("malloc");
+    }
+    stats_open(&stats, STATS_SENDER, nworkers, nconns, probe.ops->name);
+    for (int i = 0; i < nworkers; i++) {
+        init_worker(&workers[i], i, batch_size, use_gso);
+    }
+    conn_base = ((int)(now_ns() * 2654435761u) ^ getpid()) & ~STRIPE_MASK;
+    for (int t = 0; t < ntransfers; t++) {
+        for (int i = 0; i < nstripes; i++) {
+            unsigned int id = (unsigned int)conn_base + ((unsigned int)t << stripe_shift) + i;
             
-            free(sndpkt); // Free the packet after sending
+            open_connection(&conns[t * nstripes + i], &workers[i], argv[optind + 2 + t % nfiles],
+                            (int)id, nstripes > 1 ? i : -1);
         }
-        
-        // Wait for ACKs
-        if(recvfrom(sockfd, buffer, MSS_SIZE, 0,
-                   (struct sockaddr *) &serveraddr, (socklen_t *)&serverlen) < 0) {
-            error("recvfrom");
+    }
+    
+    // Log initial CWND
+    log_cwnd(conns);
+    
+    for (int i = 1; i < nworkers; i++) {
+        if (pthread_create(&workers[i].thread, NULL, worker_thread, &workers[i]) != 0) {
+            error("pthread_create");
         }
+    }
+    worker_run(&workers[0]);
+    for (int i = 1; i < nworkers; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    evlog_close(&cwnd_log); // Close CWND tracking file
+    
+    for (int i = 0; i < nworkers; i++) {
+        sender_worker *w = &workers[i];
         
-        recvpkt = (tcp_packet *)buffer;
-        assert(get_data_size(recvpkt) <= DATA_SIZE);
-        
-        VLOG(DEBUG, "Received ACK %d", recvpkt->hdr.ackno);
-        
-        // Check if this is a new ACK
-        if (recvpkt->hdr.ackno > send_base) {
-            // New ACK received
-            
-            // Calculate RTT if this ACK acknowledges the packet we're timing
-            int window_idx = get_window_index(send_base);
-            if (window_buffer[window_idx] != NULL && recvpkt->hdr.ackno > send_base) {
-                int send_time_ms = packet_sent_time[window_idx];
-                if (send_time_ms > 0) {
-                    int current_time_ms = get_current_time_ms();
-                    int measured_rtt = current_time_ms - send_time_ms;
-                    update_rtt(measured_rtt);
-                }
-            }
-            
-            // Free acknowledged packets
-            while (send_base < recvpkt->hdr.ackno) {
-                int idx = get_window_index(send_base);
-                free_window_buffer(idx);
-                
-                // Calculate the size of this packet to increment send_base correctly
-                int pkt_size = DATA_SIZE; // Default if we don't know the size
-                if (packet_size[idx] > 0) {
-                    pkt_size = packet_size[idx];
-                }
-                send_base += pkt_size;
-                packets_sent--;
-            }
-            
-            // Update congestion window based on current state
-            if (cc_state == SLOW_START) {
-                // In slow start, increment CWND by 1 for each ACK
-                // This causes exponential growth (doubles each RTT)
-                cwnd += 1.0;
-                VLOG(DEBUG, "Slow start: Increasing CWND to %.2f", cwnd);
-                
-                // Check if we should transition to congestion avoidance
-                if (cwnd >= ssthresh) {
-                    cc_state = CONGESTION_AVOIDANCE;
-                    VLOG(DEBUG, "Transitioning to Congestion Avoidance");
-                }
-            } else if (cc_state == CONGESTION_AVOIDANCE) {
-                // In congestion avoidance, increase CWND by 1/CWND for each ACK
-                // This results in linear growth of ~1 packet per RTT
-                cwnd += 1.0 / cwnd;
-                VLOG(DEBUG, "Congestion avoidance: Increasing CWND to %.2f", cwnd);
-            }
-            
-            // Log CWND change
-            log_cwnd();
-            
-            // Reset duplicate ACK count
-            dup_acks = 0;
-            last_ack = recvpkt->hdr.ackno;
-            
-            // Restart timer if there are still unacknowledged packets
-            if (packets_sent > 0) {
-                stop_timer();
-                start_timer();
-            } else {
-                stop_timer(); // All packets acknowledged
-            }
-        } else if (recvpkt->hdr.ackno == last_ack) {
-            // Duplicate ACK
-            dup_acks++;
-            VLOG(DEBUG, "Duplicate ACK %d received (%d)", recvpkt->hdr.ackno, dup_acks);
-            
-            // Fast retransmit after 3 duplicate ACKs
-            if (dup_acks == 3) {
-                VLOG(INFO, "Fast retransmit triggered");
-                
-                // Congestion control actions
-                ssthresh = (int)fmax(cwnd / 2, 2);
-                cwnd = 1.0;
-                cc_state = SLOW_START;
-                log_cwnd();
-                
-                VLOG(DEBUG, "Fast retransmit: CWND = %.2f, ssthresh = %d", cwnd, ssthresh);
-                
-                // Retransmit the lost packet
-                int index = get_window_index(send_base);
-                if (window_buffer[index] != NULL) {
-                    sndpkt = window_buffer[index];
-                    if(sendto(sockfd, sndpkt, TCP_HDR_SIZE + packet_size[index], 0, 
-                            (const struct sockaddr *)&serveraddr, serverlen) < 0) {
-                        error("sendto");
-                    }
-                    
-                    VLOG(DEBUG, "Resending packet %d with %d bytes (fast retransmit)", 
-                         send_base, packet_size[index]);
-                }
-                
-                // Reset duplicate ACK count
-                dup_acks = 0;
-                
-                // Restart timer
-                stop_timer();
-                start_timer();
-            }
+        datagrams += w->data_batch.datagrams + w->retx_batch.datagrams;
+        retransmitted += w->retx_batch.datagrams;
+        timeouts += w->timeouts;
+        send_calls += w->data_batch.syscalls + w->retx_batch.syscalls;
+        recv_calls += w->ack_syscalls;
+        loop_calls += w->loop.syscalls;
+        for (int b = 0; b < RTT_HIST_BUCKETS; b++) {
+            rtt_hist[b] += w->rtt_hist[b];
         }
+        rtt_samples += w->rtt_samples;
+        corrupt += w->st->corrupt;
+        ev_close(&w->loop);
+        close(w->sockfd);
+    }
+    for (int i = 0; i < nconns; i++) {
+        total_bytes += conns[i].send_base;
+        parity += conns[i].parity_sent;
+        rebuilt += conns[i].rebuilt;
+        unacked_eofs += !conns[i].eof_acked;
+    }
+    VLOG(INFO, "Sent %lu datagrams in %lu send syscalls", datagrams, send_calls);
+    VLOG(INFO, "Retransmitted %lu of %lu datagrams, %lu timeouts", retransmitted, datagrams, timeouts);
+    if (corrupt > 0) {
+        VLOG(INFO, "Dropped %lu ACKs that failed their CRC32C", corrupt);
+    }
+    if (fec_n > 0) {
+        VLOG(INFO, "FEC: sent %lu parity datagrams, the receiver rebuilt %lu segments", parity, rebuilt);
     }
+    VLOG(INFO, "Syscalls: %lu send, %lu recv, %lu event loop", send_calls, recv_calls, loop_calls);
+    VLOG(INFO, "Goodput %.2f Mbit/s, RTT p50 %.1f ms, p90 %.1f ms, p99 %.1f ms over %lu samples",
+         total_bytes * 8.0 / get_current_time_ms() / 1000,
+         rtt_percentile(0.5) / 1000, rtt_percentile(0.9) / 1000,
+         rtt_percentile(0.99) / 1000, rtt_samples);
+    if (unacked_eofs > 0) {
+        VLOG(WARNING, "The receiver never acknowledged the EOF of %lu transfers", unacked_eofs);
+    }
+    stats_close(&stats);
 
-    return 0;
+    return unacked_eofs > 0;
 }
-
-
-
@@ -0,0 +1,746 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <ucontext.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+
+#include "common.h"
+#include "link.h"
+
+/*
+ * rdt_sim: runs rdt_sender and rdt_receiver in one process against a
+ * simulated trace-driven link and a virtual clock.
+ *
+ * Both programs are linked in unchanged. The Makefile partially links each
+ * one into a single object, hides every symbol but its main (renamed to
+ * sender_main / receiver_main) and its verbose level, and wraps the system
+ * calls they use for time, sockets, epoll and timerfd (-Wl,--wrap), so the
+ * wrappers below stand in for the kernel:
+ *
+ *  - Each program runs as a coroutine (ucontext). A call that would block
+ *    (epoll_wait with nothing ready, recvmmsg on an empty socket) switches
+ *    back to the scheduler.
+ *  - When no program can run, the scheduler jumps the clock straight to the
+ *    next event: a timerfd deadline or a packet leaving one of the links.
+ *  - Sockets, epoll instances and timerfds are simulated file descriptors
+ *    numbered from SIM_FD_BASE; anything below it (files) is passed to the
+ *    real call.
+ *  - There is one coroutine per program and no notion of threads, so the
+ *    options that start worker threads (rdt_sender -P, rdt_receiver -n)
+ *    are refused.
+ *
+ * Processing takes no simulated time, and nothing reads a real clock or
+ * depends on scheduling, so a run is exactly repeatable: the same options
+ * give byte-identical CWND.evlog and throughput_data.evlog. (Their writer
+ * threads run in real time, but only decide when records hit the file.)
+ */
+#define SIM_FD_BASE      1000
+#define SIM_MAX_FDS      64
+#define SIM_MAX_WATCH    16
+#define SIM_STACK_SIZE   (8 << 20)
+#define SIM_START_NS     1000000000ULL         // virtual CLOCK_MONOTONIC at start
+#define SIM_EPOCH_S      1700000000            // virtual wall-clock seconds at start
+#define SIM_MAX_NS       (3600 * 1000000000ULL) // give up after an hour of simulated time
+#define SIM_PORT         5000                  // receiver port the sender is pointed at
+#define SIM_MAX_ARGS     32
+#define DEFAULT_QUEUE    100
+#define DEFAULT_DELAY_MS 20
+
+#define SIM_FREE    0
+#define SIM_SOCKET  1
+#define SIM_TIMERFD 2
+#define SIM_EPOLL   3
+
+struct sim_node;
+
+typedef struct {
+    int kind;
+    struct sim_node *owner;
+
+    // SIM_SOCKET: datagrams delivered by a link, released back to it once read
+    link_state *rx_link;
+    link_pkt *rx_head, *rx_tail;
+    uint64_t rcvtimeo_ns;        // SO_RCVTIMEO, 0 to block for good
+
+    // SIM_TIMERFD: absolute expiry, 0 when disarmed
+    uint64_t deadline_ns;
+
+    // SIM_EPOLL: interest list
+    int nwatch;
+    int watch_fd[SIM_MAX_WATCH];
+    struct epoll_event watch_ev[SIM_MAX_WATCH];
+} sim_fd;
+
+typedef struct sim_node {
+    const char *name;
+    int (*main)(int argc, char **argv);
+    int argc;
+    char *argv[SIM_MAX_ARGS];
+
+    ucontext_t ctx;
+    char *stack;
+    int started, done, status;
+    uint64_t done_ns;
+
+    int wait_fd;              // simulated fd it is blocked on, -1 when runnable
+    uint64_t wake_ns;         // epoll_wait or receive timeout, 0 for none
+    int sock;                 // its socket, -1 until created
+    struct sockaddr_in addr;  // that socket's address
+    link_state *out;          // the link its datagrams enter
+} sim_node;
+
+extern int sender_main(int argc, char **argv);
+extern int receiver_main(int argc, char **argv);
+extern int sender_verbose, receiver_verbose;
+
+ssize_t __real_read(int fd, void *buf, size_t count);
+int __real_close(int fd);
+int __real_clock_gettime(clockid_t clk, struct timespec *ts);
+void __real_exit(int status) __attribute__((noreturn));
+
+uint64_t sim_now_ns = SIM_START_NS;
+sim_fd fds[SIM_MAX_FDS];
+sim_node sender, receiver;
+sim_node *current = NULL;     // node running now, NULL in the scheduler
+ucontext_t sched_ctx;
+link_trace up_trace, down_trace;
+link_state uplink, downlink;
+
+static sim_fd *get_fd(int fd)
+{
+    if (fd < SIM_FD_BASE || fd >= SIM_FD_BASE + SIM_MAX_FDS || fds[fd - SIM_FD_BASE].kind == SIM_FREE) {
+        return NULL;
+    }
+    return &fds[fd - SIM_FD_BASE];
+}
+
+static int alloc_fd(int kind)
+{
+    for (int i = 0; i < SIM_MAX_FDS; i++) {
+        if (fds[i].kind == SIM_FREE) {
+            memset(&fds[i], 0, sizeof(fds[i]));
+            fds[i].kind = kind;
+            fds[i].owner = current;
+            return SIM_FD_BASE + i;
+        }
+    }
+    errno = EMFILE;
+    return -1;
+}
+
+// Give the CPU back to the scheduler until this node is runnable again
+static void sim_block(int fd, uint64_t wake_ns)
+{
+    current->wait_fd = fd;
+    current->wake_ns = wake_ns;
+    swapcontext(&current->ctx, &sched_ctx);
+}
+
+/* ---- Clocks ---- */
+
+int __wrap_clock_gettime(clockid_t clk, struct timespec *ts)
+{
+    uint64_t ns = sim_now_ns;
+
+    if (clk == CLOCK_REALTIME) {
+        ns += (uint64_t)SIM_EPOCH_S * 1000000000 - SIM_START_NS;
+    }
+    ts->tv_sec = ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+    return 0;
+}
+
+int __wrap_gettimeofday(struct timeval *tv, void *tz)
+{
+    struct timespec ts;
+
+    __wrap_clock_gettime(CLOCK_REALTIME, &ts);
+    tv->tv_sec = ts.tv_sec;
+    tv->tv_usec = ts.tv_nsec / 1000;
+    return 0;
+}
+
+/* ---- Sockets ---- */
+
+int __wrap_socket(int domain, int type, int protocol)
+{
+    int fd = alloc_fd(SIM_SOCKET);
+
+    if (fd >= 0) {
+        current->sock = fd;
+        get_fd(fd)->rx_link = current == &sender ? &downlink : &uplink;
+    }
+    return fd;
+}
+
+int __wrap_bind(int fd, const struct sockaddr *addr, socklen_t len)
+{
+    const struct sockaddr_in *in = (const struct sockaddr_in *)addr;
+
+    current->addr.sin_port = in->sin_port;
+    return 0;
+}
+
+int __wrap_setsockopt(int fd, int level, int name, const void *val, socklen_t len)
+{
+    sim_fd *s = get_fd(fd);
+
+    if (s != NULL && level == SOL_SOCKET && name == SO_RCVTIMEO && len >= sizeof(struct timeval)) {
+        const struct timeval *tv = val;
+        s->rcvtimeo_ns = tv->tv_sec * 1000000000ULL + tv->tv_usec * 1000ULL;
+    }
+    return 0;  // Buffer sizes, SO_TXTIME, ...: nothing else to configure
+}
+
+// Puts one datagram on the node's outgoing link, split by a UDP_SEGMENT size if given
+static void sim_transmit(const char *buf, size_t len, int gso_size)
+{
+    uint64_t now_us = sim_now_ns / 1000;
+
+    if (gso_size <= 0) {
+        gso_size = len;
+    }
+    for (size_t off = 0; off < len; off += gso_size) {
+        size_t n = len - off < (size_t)gso_size ? len - off : (size_t)gso_size;
+        link_enqueue(current->out, buf + off, n, 0, now_us);
+    }
+}
+
+static size_t gather(const struct msghdr *msg, char *buf, size_t cap)
+{
+    size_t len = 0;
+
+    for (size_t i = 0; i < msg->msg_iovlen; i++) {
+        size_t n = msg->msg_iov[i].iov_len;
+        if (len + n > cap) {
+            n = cap - len;
+        }
+        memcpy(buf + len, msg->msg_iov[i].iov_base, n);
+        len += n;
+    }
+    return len;
+}
+
+int __wrap_sendmmsg(int fd, struct mmsghdr *msgs, unsigned int vlen, int flags)
+{
+    static char buf[65536];
+
+    for (unsigned int m = 0; m < vlen; m++) {
+        struct msghdr *msg = &msgs[m].msg_hdr;
+        struct cmsghdr *cm;
+        int gso_size = 0;
+
+        for (cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR(msg, cm)) {
+            if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_SEGMENT) {
+                unsigned short seg;
+                memcpy(&seg, CMSG_DATA(cm), sizeof(seg));
+                gso_size = seg;
+            }
+        }
+        msgs[m].msg_len = gather(msg, buf, sizeof(buf));
+        sim_transmit(buf, msgs[m].msg_len, gso_size);
+    }
+    return vlen;
+}
+
+ssize_t __wrap_sendto(int fd, const void *buf, size_t len, int flags,
+                      const struct sockaddr *addr, socklen_t addrlen)
+{
+    sim_transmit(buf, len, 0);
+    return len;
+}
+
+// Takes the oldest datagram off a socket into buf; returns its length
+static size_t sim_take(sim_fd *s, struct iovec *iov, size_t iovlen, void *addr, socklen_t *addrlen)
+{
+    link_pkt *p = s->rx_head;
+    size_t off = 0;
+
+    s->rx_head = p->next;
+    if (s->rx_head == NULL) {
+        s->rx_tail = NULL;
+    }
+    for (size_t i = 0; i < iovlen && off < (size_t)p->len; i++) {
+        size_t n = p->len - off < iov[i].iov_len ? p->len - off : iov[i].iov_len;
+        memcpy(iov[i].iov_base, p->data + off, n);
+        off += n;
+    }
+    if (addr != NULL && addrlen != NULL) {
+        // Every datagram comes from the other node
+        sim_node *peer = current == &sender ? &receiver : &sender;
+        socklen_t n = *addrlen < sizeof(peer->addr) ? *addrlen : sizeof(peer->addr);
+        memcpy(addr, &peer->addr, n);
+        *addrlen = sizeof(peer->addr);
+    }
+    link_release(s->rx_link, p);
+    return off;
+}
+
+// Blocks until a datagram is queued on s; -1 (EAGAIN) if it may not block
+// or its receive timeout runs out first
+static int sim_wait_datagram(int fd, sim_fd *s, int flags)
+{
+    uint64_t deadline_ns = s->rcvtimeo_ns != 0 ? sim_now_ns + s->rcvtimeo_ns : 0;
+
+    while (s->rx_head == NULL) {
+        if (flags & MSG_DONTWAIT || (deadline_ns != 0 && sim_now_ns >= deadline_ns)) {
+            errno = EAGAIN;
+            return -1;
+        }
+        sim_block(fd, deadline_ns);
+    }
+    return 0;
+}
+
+int __wrap_recvmmsg(int fd, struct mmsghdr *msgs, unsigned int vlen, int flags, struct timespec *timeout)
+{
+    sim_fd *s = get_fd(fd);
+    unsigned int n = 0;
+
+    if (sim_wait_datagram(fd, s, flags) < 0) {
+        return -1;
+    }
+    while (n < vlen && s->rx_head != NULL) {
+        struct msghdr *msg = &msgs[n].msg_hdr;
+        msgs[n].msg_len = sim_take(s, msg->msg_iov, msg->msg_iovlen, msg->msg_name, &msg->msg_namelen);
+        n++;
+    }
+    return n;
+}
+
+ssize_t __wrap_recvfrom(int fd, void *buf, size_t len, int flags,
+                        struct sockaddr *addr, socklen_t *addrlen)
+{
+    sim_fd *s = get_fd(fd);
+    struct iovec iov = {.iov_base = buf, .iov_len = len};
+
+    if (sim_wait_datagram(fd, s, flags) < 0) {
+        return -1;
+    }
+    return sim_take(s, &iov, 1, addr, addrlen);
+}
+
+/* ---- timerfd and epoll ---- */
+
+int __wrap_timerfd_create(int clockid, int flags)
+{
+    return alloc_fd(SIM_TIMERFD);
+}
+
+int __wrap_timerfd_settime(int fd, int flags, const struct itimerspec *new, struct itimerspec *old)
+{
+    sim_fd *t = get_fd(fd);
+    uint64_t ns = (uint64_t)new->it_value.tv_sec * 1000000000 + new->it_value.tv_nsec;
+
+    if (ns == 0) {
+        t->deadline_ns = 0;
+    } else {
+        t->deadline_ns = flags & TFD_TIMER_ABSTIME ? ns : sim_now_ns + ns;
+    }
+    return 0;
+}
+
+ssize_t __wrap_read(int fd, void *buf, size_t count)
+{
+    sim_fd *t = get_fd(fd);
+    uint64_t expirations = 1;
+
+    if (t == NULL) {
+        return __real_read(fd, buf, count);
+    }
+    if (t->kind != SIM_TIMERFD || t->deadline_ns == 0 || t->deadline_ns > sim_now_ns) {
+        errno = EAGAIN;
+        return -1;
+    }
+    t->deadline_ns = 0;  // one-shot
+    memcpy(buf, &expirations, sizeof(expirations));
+    return sizeof(expirations);
+}
+
+int __wrap_close(int fd)
+{
+    sim_fd *f = get_fd(fd);
+
+    if (f == NULL) {
+        return __real_close(fd);
+    }
+    f->kind = SIM_FREE;
+    return 0;
+}
+
+int __wrap_epoll_create1(int flags)
+{
+    return alloc_fd(SIM_EPOLL);
+}
+
+int __wrap_epoll_ctl(int epfd, int op, int fd, struct epoll_event *ev)
+{
+    sim_fd *ep = get_fd(epfd);
+
+    if (op != EPOLL_CTL_ADD || ep->nwatch == SIM_MAX_WATCH) {
+        errno = EINVAL;
+        return -1;
+    }
+    ep->watch_fd[ep->nwatch] = fd;
+    ep->watch_ev[ep->nwatch] = *ev;
+    ep->nwatch++;
+    return 0;
+}
+
+// Fills events with what is ready on an epoll instance; returns how many
+static int epoll_ready(sim_fd *ep, struct epoll_event *events, int max)
+{
+    int n = 0;
+
+    for (int i = 0; i < ep->nwatch && n < max; i++) {
+        sim_fd *f = get_fd(ep->watch_fd[i]);
+        int ready = 0;
+
+        if (f == NULL) {
+            continue;
+        }
+        if (f->kind == SIM_SOCKET) {
+            ready = f->rx_head != NULL;
+        } else if (f->kind == SIM_TIMERFD) {
+            ready = f->deadline_ns != 0 && f->deadline_ns <= sim_now_ns;
+        }
+        if (ready && (ep->watch_ev[i].events & EPOLLIN)) {
+            if (events != NULL) {
+                events[n].events = EPOLLIN;
+                events[n].data = ep->watch_ev[i].data;
+            }
+            n++;
+        }
+    }
+    return n;
+}
+
+int __wrap_epoll_wait(int epfd, struct epoll_event *events, int max, int timeout_ms)
+{
+    sim_fd *ep = get_fd(epfd);
+    uint64_t wake_ns = timeout_ms > 0 ? sim_now_ns + (uint64_t)timeout_ms * 1000000 : 0;
+    int n;
+
+    while ((n = epoll_ready(ep, events, max)) == 0) {
+        if (timeout_ms == 0 || (wake_ns != 0 && sim_now_ns >= wake_ns)) {
+            return 0;
+        }
+        sim_block(epfd, wake_ns);
+    }
+    return n;
+}
+
+/* ---- Nodes and scheduler ---- */
+
+// A node that exits ends its coroutine instead of the process
+void __wrap_exit(int status)
+{
+    if (current == NULL) {
+        __real_exit(status);
+    }
+    current->status = status;
+    current->done = 1;
+    current->done_ns = sim_now_ns;
+    setcontext(&sched_ctx);
+    __real_exit(status);  // not reached
+}
+
+static void node_entry()
+{
+    optind = 0;  // both programs parse their options with getopt
+    __wrap_exit(current->main(current->argc, current->argv));
+}
+
+// Whether a blocked node has something to do now
+static int node_runnable(sim_node *n)
+{
+    sim_fd *f;
+
+    if (n->done) {
+        return 0;
+    }
+    if (!n->started || n->wait_fd < 0) {
+        return 1;
+    }
+    if (n->wake_ns != 0 && sim_now_ns >= n->wake_ns) {
+        return 1;
+    }
+    f = get_fd(n->wait_fd);
+    if (f->kind == SIM_EPOLL) {
+        return epoll_ready(f, NULL, SIM_MAX_WATCH) > 0;
+    }
+    return f->rx_head != NULL;
+}
+
+static void node_run(sim_node *n)
+{
+    current = n;
+    n->wait_fd = -1;
+    if (!n->started) {
+        n->started = 1;
+        n->stack = malloc(SIM_STACK_SIZE);
+        if (n->stack == NULL) {
+            error("malloc");
+        }
+        getcontext(&n->ctx);
+        n->ctx.uc_stack.ss_sp = n->stack;
+        n->ctx.uc_stack.ss_size = SIM_STACK_SIZE;
+        n->ctx.uc_link = &sched_ctx;
+        makecontext(&n->ctx, node_entry, 0);
+    }
+    swapcontext(&sched_ctx, &n->ctx);
+    current = NULL;
+}
+
+// Hand every packet a link has released by now to the node it is headed for
+static void deliver(link_state *l, sim_node *to)
+{
+    link_pkt *p;
+
+    while ((p = link_dequeue(l, sim_now_ns / 1000)) != NULL) {
+        sim_fd *s = to->sock >= 0 ? get_fd(to->sock) : NULL;
+
+        if (s == NULL) {
+            link_release(l, p);  // nobody listening
+            continue;
+        }
+        p->next = NULL;
+        if (s->rx_tail != NULL) {
+            s->rx_tail->next = p;
+        } else {
+            s->rx_head = p;
+        }
+        s->rx_tail = p;
+    }
+}
+
+// The earliest time anything can happen, 0 if nothing ever will
+static uint64_t next_event()
+{
+    uint64_t next = UINT64_MAX;
+    uint64_t us;
+    sim_node *nodes[] = {&sender, &receiver};
+
+    for (int i = 0; i < SIM_MAX_FDS; i++) {
+        if (fds[i].kind == SIM_TIMERFD && fds[i].deadline_ns != 0 && fds[i].deadline_ns < next) {
+            next = fds[i].deadline_ns;
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        if (!nodes[i]->done && nodes[i]->wake_ns != 0 && nodes[i]->wake_ns < next) {
+            next = nodes[i]->wake_ns;
+        }
+    }
+    if ((us = link_next_event(&uplink)) != LINK_IDLE && us * 1000 < next) {
+        next = us * 1000;
+    }
+    if ((us = link_next_event(&downlink)) != LINK_IDLE && us * 1000 < next) {
+        next = us * 1000;
+    }
+    return next == UINT64_MAX ? 0 : next;
+}
+
+// Splits a flag string on spaces into the node's argv, after argv[0]
+static void node_args(sim_node *n, const char *flags)
+{
+    static char storage[2][1024];
+    char *s = storage[n == &receiver], *tok;
+
+    n->argv[n->argc++] = (char *)n->name;
+    snprintf(s, sizeof(storage[0]), "%s", flags != NULL ? flags : "");
+    for (tok = strtok(s, " "); tok != NULL && n->argc < SIM_MAX_ARGS - 4; tok = strtok(NULL, " ")) {
+        n->argv[n->argc++] = tok;
+    }
+}
+
+// The value given to option -opt in the node's flags, def if it has none
+static int node_option(sim_node *n, char opt, int def)
+{
+    for (int i = 1; i < n->argc; i++) {
+        if (n->argv[i][0] == '-' && n->argv[i][1] == opt) {
+            if (n->argv[i][2] != '\0') {
+                def = atoi(n->argv[i] + 2);
+            } else if (i + 1 < n->argc) {
+                def = atoi(n->argv[++i]);
+            }
+        }
+    }
+    return def;
+}
+
+static void node_init(sim_node *n, const char *name, int (*main)(int, char **), link_state *out)
+{
+    memset(n, 0, sizeof(*n));
+    n->name = name;
+    n->main = main;
+    n->out = out;
+    n->sock = -1;
+    n->wait_fd = -1;
+    n->addr.sin_family = AF_INET;
+    n->addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    int queue_max = DEFAULT_QUEUE;
+    double delay_ms = DEFAULT_DELAY_MS;
+    double loss = 0, corrupt = 0;
+    unsigned int seed = 1;
+    const char *down_path = NULL, *log_path = NULL;
+    const char *sender_flags = NULL, *receiver_flags = NULL;
+    int node_verbose = NONE;
+    char port[16];
+    struct timespec cpu0, cpu1;
+    FILE *in;
+    long in_size;
+    double cpu_s, sim_s;
+
+    while ((opt = getopt(argc, argv, "d:D:e:l:o:q:R:s:S:v")) != -1) {
+        switch (opt) {
+        case 'd':
+            delay_ms = atof(optarg);
+            break;
+        case 'D':
+            down_path = optarg;
+            break;
+        case 'e':
+            corrupt = atof(optarg);
+            break;
+        case 'l':
+            loss = atof(optarg);
+            break;
+        case 'o':
+            log_path = optarg;
+            break;
+        case 'q':
+            queue_max = atoi(optarg);
+            break;
+        case 'R':
+            receiver_flags = optarg;
+            break;
+        case 's':
+            seed = atoi(optarg);
+            break;
+        case 'S':
+            sender_flags = optarg;
+            break;
+        case 'v':
+            node_verbose = ALL;
+            break;
+        default:
+            argc = 0;  // force the usage message
+        }
+    }
+    if (argc - optind != 3 || queue_max <= 0 || loss < 0 || loss >= 1 || corrupt < 0 || corrupt >= 1) {
+        fprintf(stderr, "usage: %s [-d delay_ms] [-D downlink_trace] [-e corrupt] [-l loss] [-o qdelay_log] [-q queue_pkts] "
+                "[-R \"receiver flags\"] [-s seed] [-S \"sender flags\"] [-v] <uplink_trace> <FILE> <FILE_RECVD>\n",
+                argv[0]);
+        fprintf(stderr, "  the programs run as coroutines without threads: -S may not hold -P, nor -R -n\n");
+        exit(1);
+    }
+    if (load_trace(&up_trace, argv[optind]) < 0) {
+        fprintf(stderr, "ERROR, cannot read trace %s\n", argv[optind]);
+        exit(1);
+    }
+    if (down_path != NULL && load_trace(&down_trace, down_path) < 0) {
+        fprintf(stderr, "ERROR, cannot read trace %s\n", down_path);
+        exit(1);
+    }
+    if ((in = fopen(argv[optind + 1], "r")) == NULL) {
+        error(argv[optind + 1]);
+    }
+    fseek(in, 0, SEEK_END);
+    in_size = ftell(in);
+    fclose(in);
+
+    link_init(&uplink, &up_trace, queue_max, delay_ms * 1000, loss, corrupt, seed);
+    // Its own seed, so the two directions do not corrupt the same datagrams
+    link_init(&downlink, down_path != NULL ? &down_trace : NULL, queue_max, delay_ms * 1000, 0, corrupt,
+              seed ^ 0x5bd1e995);
+    if (log_path != NULL && link_open_log(&uplink, log_path) < 0) {
+        error("Cannot open queueing delay log");
+    }
+
+    // The receiver starts first so its socket is bound before data arrives
+    snprintf(port, sizeof(port), "%d", SIM_PORT);
+    node_init(&receiver, "rdt_receiver", receiver_main, &downlink);
+    node_args(&receiver, receiver_flags);
+    receiver.argv[receiver.argc++] = port;
+    receiver.argv[receiver.argc++] = argv[optind + 2];
+    node_init(&sender, "rdt_sender", sender_main, &uplink);
+    node_args(&sender, sender_flags);
+    // Each program is one coroutine, so neither may start threads of its own
+    if (node_option(&sender, 'P', 1) > 1 || node_option(&receiver, 'n', 0) != 0) {
+        fprintf(stderr, "ERROR, rdt_sender -P and rdt_receiver -n run worker threads, which rdt_sim "
+                "cannot schedule; run them against link_emu instead\n");
+        exit(1);
+    }
+    sender.argv[sender.argc++] = "127.0.0.1";
+    sender.argv[sender.argc++] = port;
+    sender.argv[sender.argc++] = argv[optind + 1];
+    sender.addr.sin_port = htons(SIM_PORT + 1);
+    sender_verbose = receiver_verbose = node_verbose;
+
+    __real_clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu0);
+    while (!sender.done || !receiver.done) {
+        int ran = 0;
+        uint64_t next;
+
+        if (node_runnable(&receiver)) {
+            node_run(&receiver);
+            ran = 1;
+        }
+        if (node_runnable(&sender)) {
+            node_run(&sender);
+            ran = 1;
+        }
+        if (ran) {
+            continue;
+        }
+        next = next_event();
+        if (next == 0 || next - SIM_START_NS > SIM_MAX_NS) {
+            fprintf(stderr, "Simulation stalled at %.3f s: %s\n", (sim_now_ns - SIM_START_NS) / 1e9,
+                    !sender.done ? "sender did not finish" : "receiver never saw EOF");
+            break;
+        }
+        if (next > sim_now_ns) {
+            sim_now_ns = next;
+        }
+        deliver(&uplink, &receiver);
+        deliver(&downlink, &sender);
+    }
+    __real_clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu1);
+
+    cpu_s = (cpu1.tv_sec - cpu0.tv_sec) + (cpu1.tv_nsec - cpu0.tv_nsec) / 1e9;
+    sim_s = ((sender.done ? sender.done_ns : sim_now_ns) - SIM_START_NS) / 1e9;
+    if (sender.done) {
+        printf("sender: exit %d after %.3f s simulated, goodput %.2f Mbit/s\n",
+               sender.status, sim_s, in_size * 8 / sim_s / 1e6);
+    } else {
+        printf("sender: did not finish in %.3f s simulated\n", sim_s);
+    }
+    if (receiver.done) {
+        printf("receiver: exit %d after %.3f s simulated\n",
+               receiver.status, (receiver.done_ns - SIM_START_NS) / 1e9);
+    } else {
+        printf("receiver: did not finish in %.3f s simulated\n", (sim_now_ns - SIM_START_NS) / 1e9);
+    }
+    link_report(&uplink, "uplink", stdout);
+    link_report(&downlink, "downlink", stdout);
+    printf("CPU time %.3f s (%.0fx real time)\n", cpu_s, cpu_s > 0 ? sim_s / cpu_s : 0);
+
+    if (uplink.log != NULL) {
+        fclose(uplink.log);
+    }
+    return !(sender.done && receiver.done && sender.status == 0 && receiver.status == 0);
+}
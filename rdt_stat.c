@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "event.h"
+#include "cc.h"
+#include "stats.h"
+
+/*
+ * rdt_stat: live view of running rdt_sender and rdt_receiver processes.
+ *
+ * Every interval it copies each /dev/shm/rdt_<role>.<pid> region (see
+ * stats.h) and prints, per worker, syscall and datagram rates and, per
+ * connection, goodput and the transport state: the sender's window, RTT
+ * estimate and percentiles, retransmissions and time in each congestion
+ * state; the receiver's reassembly buffer, duplicates and writes. Rates
+ * are the difference between two copies, so the first report comes one
+ * interval after startup. The processes being watched do no extra work.
+ */
+
+#define SHM_DIR       "/dev/shm"
+#define MAX_REGIONS   64
+
+typedef struct {
+    char name[NAME_MAX + 1];     // file name in SHM_DIR
+    int pid;
+    char *copy;                  // snapshot of the region, NULL if none yet
+    size_t len;
+    uint64_t taken_us;           // when the copy was taken
+    int seen;                    // found by the current scan
+} region;
+
+region regions[MAX_REGIONS];
+int nregions;
+
+static const char *cc_state_names[] = {"slow-start", "cong-avoid", "fast-retx"};
+
+// A process that no longer exists left its region behind
+static int alive(int pid)
+{
+    return kill(pid, 0) == 0 || errno == EPERM;
+}
+
+static region *find_region(const char *name)
+{
+    for (int i = 0; i < nregions; i++) {
+        if (strcmp(regions[i].name, name) == 0) {
+            return &regions[i];
+        }
+    }
+    if (nregions == MAX_REGIONS) {
+        return NULL;
+    }
+    memset(&regions[nregions], 0, sizeof(region));
+    strncpy(regions[nregions].name, name, NAME_MAX);
+    return &regions[nregions++];
+}
+
+// Copy the region into *buf, grown to fit; returns its size, or 0 if it is not ready
+static size_t copy_region(const char *name, char **buf)
+{
+    char path[sizeof(SHM_DIR) + NAME_MAX + 1];
+    struct stat st;
+    size_t len;
+    char *map;
+    int fd;
+
+    snprintf(path, sizeof(path), SHM_DIR "/%s", name);
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(stats_header)) {
+        close(fd);
+        return 0;
+    }
+    len = st.st_size;
+    map = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    if (__atomic_load_n(&((stats_header *)map)->magic, __ATOMIC_ACQUIRE) != STATS_MAGIC ||
+        ((stats_header *)map)->version != STATS_VERSION) {
+        munmap(map, len);
+        return 0;
+    }
+    *buf = realloc(*buf, len);
+    if (*buf == NULL) {
+        error("realloc");
+    }
+    memcpy(*buf, map, len);
+    munmap(map, len);
+    return len;
+}
+
+static double rate(uint64_t now, uint64_t before, double seconds)
+{
+    return seconds > 0 ? (now - before) / seconds : 0;
+}
+
+// Smallest bucket bound below which a fraction q of the samples lie
+static uint64_t percentile(const uint64_t *hist, double q)
+{
+    uint64_t total = 0, seen = 0;
+
+    for (int i = 0; i < STATS_HIST_BUCKETS; i++) {
+        total += hist[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    for (int i = 0; i < STATS_HIST_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen >= q * total) {
+            return stats_hist_lower(i);
+        }
+    }
+    return stats_hist_lower(STATS_HIST_BUCKETS - 1);
+}
+
+static void print_workers(const stats_header *hdr, const stats_worker *now,
+                          const stats_worker *before, double seconds)
+{
+    printf("  %-6s %10s %10s %10s %10s %12s %12s %8s\n", "worker", "send/s", "recv/s",
+           hdr->role == STATS_SENDER ? "loop/s" : "write/s", "syscalls/s", "dgrams out/s", "dgrams in/s",
+           "corrupt");
+    for (uint32_t i = 0; i < hdr->nworkers; i++) {
+        const stats_worker *a = &now[i], *b = &before[i];
+        uint64_t other = hdr->role == STATS_SENDER ? a->loop_syscalls : a->write_syscalls;
+        uint64_t other_before = hdr->role == STATS_SENDER ? b->loop_syscalls : b->write_syscalls;
+        uint64_t total = a->send_syscalls + a->recv_syscalls + other;
+        uint64_t total_before = b->send_syscalls + b->recv_syscalls + other_before;
+
+        printf("  %-6u %10.0f %10.0f %10.0f %10.0f %12.0f %12.0f %8lu\n", i,
+               rate(a->send_syscalls, b->send_syscalls, seconds),
+               rate(a->recv_syscalls, b->recv_syscalls, seconds),
+               rate(other, other_before, seconds),
+               rate(total, total_before, seconds),
+               rate(a->datagrams_sent, b->datagrams_sent, seconds),
+               rate(a->datagrams_received, b->datagrams_received, seconds), a->corrupt);
+    }
+}
+
+static void print_sender_conn(const stats_conn *a, const stats_conn *b, double seconds, uint64_t now)
+{
+    const stats_sender_conn *s = &a->s;
+    uint64_t until = a->state == STATS_DONE ? a->end_us : now;
+    uint64_t in_state[3];
+    double total = 0;
+
+    memcpy(in_state, s->state_us, sizeof(in_state));
+    if (s->cc_state >= 0 && s->cc_state < 3 && until > s->state_since_us) {
+        in_state[s->cc_state] += until - s->state_since_us;
+    }
+    for (int i = 0; i < 3; i++) {
+        total += in_state[i];
+    }
+    if (total == 0) {
+        total = 1;
+    }
+    printf("  %-10u %-6s %8.2f %10lu %8.1f %6d %5d %-10s %3.0f/%3.0f/%3.0f %7.1f %7.1f %7.1f/%-7.1f %6lu/%-6lu %5lu %7lu %5d %8lu %8lu %6.2f\n",
+           (uint32_t)a->conn_id, a->state == STATS_DONE ? "done" : "active",
+           8 * rate(s->bytes_acked, b->s.bytes_acked, seconds) / 1e6, s->bytes_acked,
+           s->cwnd, s->ssthresh, s->pipe,
+           s->cc_state >= 0 && s->cc_state < 3 ? cc_state_names[s->cc_state] : "?",
+           100 * in_state[SLOW_START] / total, 100 * in_state[CONGESTION_AVOIDANCE] / total,
+           100 * in_state[FAST_RETRANSMIT] / total,
+           s->srtt_us / 1e3, s->rto_us / 1e3,
+           percentile(s->rtt_hist, 0.5) / 1e3, percentile(s->rtt_hist, 0.99) / 1e3,
+           s->retx_fast, s->retx_timeout, s->timeouts, s->dup_acks,
+           s->fec_k, s->parity_sent, s->rebuilt, 100 * s->loss_rate);
+}
+
+static void print_receiver_conn(const stats_conn *a, const stats_conn *b, double seconds)
+{
+    const stats_receiver_conn *r = &a->r;
+
+    printf("  %-10u %-6s %6d %8.2f %10lu %9lu %6lu %6lu %5d/%-5d %8lu %7lu %8lu %8lu %8s\n",
+           (uint32_t)a->conn_id, a->state == STATS_DONE ? "done" : "active", a->worker,
+           8 * rate(r->bytes_received, b->r.bytes_received, seconds) / 1e6, r->bytes_received,
+           r->segments_received, r->duplicates, r->out_of_order,
+           r->held_segments, r->max_held_segments, r->acks_sent, r->writes,
+           r->parity_received, r->rebuilt,
+           r->verified > 0 ? "ok" : r->verified < 0 ? "MISMATCH" : "-");
+}
+
+static void report(region *rg, const char *now, size_t len, uint64_t taken_us)
+{
+    const stats_header *hdr = (const stats_header *)now;
+    const char *before = rg->copy != NULL && rg->len == len ? rg->copy : now;
+    double seconds = before == now ? 0 : (taken_us - rg->taken_us) / 1e6;
+    const stats_worker *workers = (const stats_worker *)(now + sizeof(stats_header));
+    const stats_conn *conns = (const stats_conn *)(workers + hdr->nworkers);
+    size_t offset = (const char *)conns - now;
+
+    if (offset + hdr->nslots * sizeof(stats_conn) > len) {
+        return;  // not a region this build understands
+    }
+    printf("%s pid %d%s%s%s, %u worker%s, up %.1f s\n",
+           hdr->role == STATS_SENDER ? "rdt_sender" : "rdt_receiver", hdr->pid,
+           hdr->cc_name[0] != '\0' ? " (" : "", hdr->cc_name, hdr->cc_name[0] != '\0' ? ")" : "",
+           hdr->nworkers, hdr->nworkers == 1 ? "" : "s", (taken_us - hdr->start_us) / 1e6);
+    print_workers(hdr, workers, (const stats_worker *)(before + sizeof(stats_header)), seconds);
+
+    if (hdr->role == STATS_SENDER) {
+        printf("  %-10s %-6s %8s %10s %8s %6s %5s %-10s %11s %7s %7s %15s %13s %5s %7s %5s %8s %8s %6s\n",
+               "conn", "state", "Mbit/s", "acked", "cwnd", "ssthr", "pipe", "cc state",
+               "ss/ca/fr %", "srtt ms", "rto ms", "rtt p50/p99 ms", "retx fast/rto", "rtos", "dupacks",
+               "fec k", "parity", "rebuilt", "loss %");
+    } else {
+        printf("  %-10s %-6s %6s %8s %10s %9s %6s %6s %11s %8s %7s %8s %8s %8s\n",
+               "conn", "state", "worker", "Mbit/s", "received", "segments", "dups", "ooo",
+               "held/max", "acks", "writes", "parity", "rebuilt", "file crc");
+    }
+    for (uint32_t i = 0; i < hdr->nslots; i++) {
+        const stats_conn *a = &conns[i];
+        const stats_conn *b = (const stats_conn *)(before + offset) + i;
+
+        if (a->state == STATS_FREE) {
+            continue;
+        }
+        if (b->state == STATS_FREE || b->conn_id != a->conn_id || b->start_us != a->start_us) {
+            b = a;  // a new connection in this slot: no rate yet
+        }
+        if (hdr->role == STATS_SENDER) {
+            print_sender_conn(a, b, seconds, taken_us);
+        } else {
+            print_receiver_conn(a, b, seconds);
+        }
+    }
+    printf("\n");
+}
+
+// One pass over SHM_DIR: report every live region, keep its copy for the next
+static int scan(int only_pid, int print)
+{
+    DIR *dir = opendir(SHM_DIR);
+    struct dirent *de;
+    int found = 0;
+    char *buf = NULL;
+
+    if (dir == NULL) {
+        error(SHM_DIR);
+    }
+    for (int i = 0; i < nregions; i++) {
+        regions[i].seen = 0;
+    }
+    while ((de = readdir(dir)) != NULL) {
+        const char *dot;
+        region *rg;
+        size_t len;
+        uint64_t taken_us;
+        int pid;
+
+        if (strncmp(de->d_name, STATS_SHM_PREFIX, strlen(STATS_SHM_PREFIX)) != 0 ||
+            (dot = strrchr(de->d_name, '.')) == NULL) {
+            continue;
+        }
+        pid = atoi(dot + 1);
+        if (pid <= 0 || (only_pid > 0 && pid != only_pid) || !alive(pid)) {
+            continue;
+        }
+        len = copy_region(de->d_name, &buf);
+        taken_us = now_us();
+        if (len == 0 || (rg = find_region(de->d_name)) == NULL) {
+            continue;
+        }
+        rg->pid = pid;
+        rg->seen = 1;
+        if (print) {
+            report(rg, buf, len, taken_us);
+        }
+        free(rg->copy);
+        rg->copy = buf;
+        rg->len = len;
+        rg->taken_us = taken_us;
+        buf = NULL;
+        found++;
+    }
+    closedir(dir);
+    free(buf);
+
+    // Forget the processes that went away
+    for (int i = 0; i < nregions; i++) {
+        if (!regions[i].seen) {
+            free(regions[i].copy);
+            regions[i--] = regions[--nregions];
+        }
+    }
+    return found;
+}
+
+int main(int argc, char **argv)
+{
+    int opt;
+    int interval_ms = 1000;
+    long count = 0;
+    int pid = 0;
+    struct timespec pause;
+
+    while ((opt = getopt(argc, argv, "i:n:")) != -1) {
+        switch (opt) {
+        case 'i':
+            interval_ms = atoi(optarg);
+            break;
+        case 'n':
+            count = atol(optarg);
+            break;
+        default:
+            argc = 0;  // force the usage message
+        }
+    }
+    if (argc - optind > 1 || interval_ms <= 0 || count < 0) {
+        fprintf(stderr, "usage: %s [-i interval_ms] [-n count] [pid]\n", argv[0]);
+        fprintf(stderr, "  reports every running rdt_sender and rdt_receiver (or just pid)\n"
+                "  every interval_ms, count times (default: until interrupted)\n");
+        exit(1);
+    }
+    if (optind < argc) {
+        pid = atoi(argv[optind]);
+    }
+    pause.tv_sec = interval_ms / 1000;
+    pause.tv_nsec = (interval_ms % 1000) * 1000000L;
+
+    // The first pass only takes the copies the rates start from
+    scan(pid, 0);
+    setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+    for (long n = 0; count == 0 || n < count; n++) {
+        nanosleep(&pause, NULL);
+        if (scan(pid, 1) == 0) {
+            printf("no rdt_sender or rdt_receiver running%s\n\n", pid > 0 ? " with that pid" : "");
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
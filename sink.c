@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "event.h"
+#include "sink.h"
+
+void sink_open(file_sink *s, const char *path, off_t prealloc, int sync_interval_ms, int shared)
+{
+    memset(s, 0, sizeof(*s));
+    s->sync_interval_ms = sync_interval_ms;
+    s->last_sync_ms = now_us() / 1000;
+    s->shared = shared;
+
+    s->fd = open(path, O_RDWR | O_CREAT | (shared ? 0 : O_TRUNC), 0644);
+    if (s->fd < 0) {
+        error((char *)path);
+    }
+    if (prealloc <= 0 || shared) {
+        return;
+    }
+
+    // Reserve the blocks up front, then write through a shared mapping
+    if (fallocate(s->fd, 0, 0, prealloc) < 0 && ftruncate(s->fd, prealloc) < 0) {
+        error("ftruncate");
+    }
+    s->map = mmap(NULL, prealloc, PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+    if (s->map == MAP_FAILED) {
+        VLOG(WARNING, "mmap of %s failed, using pwritev", path);
+        s->map = NULL;
+        return;
+    }
+    s->map_len = prealloc;
+}
+
+// Grow the output mapping so that it covers `needed` bytes
+static void grow_map(file_sink *s, size_t needed)
+{
+    size_t new_len = s->map_len * 2;
+    char *map;
+
+    if (new_len < needed) {
+        new_len = needed;
+    }
+    if (fallocate(s->fd, 0, 0, new_len) < 0 && ftruncate(s->fd, new_len) < 0) {
+        error("ftruncate");
+    }
+    map = mremap(s->map, s->map_len, new_len, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) {
+        error("mremap");
+    }
+    s->map = map;
+    s->map_len = new_len;
+}
+
+static void sync_if_due(file_sink *s)
+{
+    uint64_t now_ms;
+
+    if (s->sync_interval_ms <= 0) {
+        return;
+    }
+    now_ms = now_us() / 1000;
+    if (now_ms - s->last_sync_ms < (uint64_t)s->sync_interval_ms) {
+        return;
+    }
+    if (s->map != NULL) {
+        msync(s->map, s->end, MS_ASYNC);
+    }
+    fdatasync(s->fd);
+    s->syncs++;
+    s->last_sync_ms = now_ms;
+}
+
+// Write out the pending run with as few pwritev calls as the kernel allows
+static void write_run(file_sink *s)
+{
+    struct iovec *iov = s->iov;
+    int niov = s->niov;
+    off_t offset = s->run_offset;
+
+    while (niov > 0) {
+        ssize_t n = pwritev(s->fd, iov, niov, offset);
+        s->writes++;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error("pwritev");
+        }
+        offset += n;
+        // Skip the iovecs that were fully written, trim a partially written one
+        while (niov > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            niov--;
+        }
+        if (niov > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+
+    for (int i = 0; i < s->niov; i++) {
+        if (s->owners[i] != NULL && s->release != NULL) {
+            s->release(s->owners[i]);
+        }
+    }
+    s->niov = 0;
+    s->run_len = 0;
+}
+
+void sink_write(file_sink *s, off_t offset, const void *data, size_t len, void *owner)
+{
+    if (offset + (off_t)len > s->end) {
+        s->end = offset + len;
+    }
+
+    if (s->map != NULL) {
+        if ((size_t)(offset + len) > s->map_len) {
+            grow_map(s, offset + len);
+        }
+        memcpy(s->map + offset, data, len);
+        if (owner != NULL && s->release != NULL) {
+            s->release(owner);
+        }
+        return;
+    }
+
+    // Start a new run if this segment does not extend the pending one
+    if (s->niov > 0 && (s->niov == SINK_MAX_IOV || offset != s->run_offset + (off_t)s->run_len)) {
+        write_run(s);
+    }
+    if (s->niov == 0) {
+        s->run_offset = offset;
+    }
+    s->iov[s->niov].iov_base = (void *)data;
+    s->iov[s->niov].iov_len = len;
+    s->owners[s->niov] = owner;
+    s->niov++;
+    s->run_len += len;
+}
+
+void sink_flush(file_sink *s)
+{
+    if (s->niov > 0) {
+        write_run(s);
+    }
+    sync_if_due(s);
+}
+
+void sink_close(file_sink *s)
+{
+    if (s->niov > 0) {
+        write_run(s);
+    }
+    if (s->map != NULL) {
+        msync(s->map, s->end, MS_SYNC);
+        munmap(s->map, s->map_len);
+        s->map = NULL;
+    }
+    // Drop any preallocated tail beyond what was received
+    if (!s->shared && ftruncate(s->fd, s->end) < 0) {
+        error("ftruncate");
+    }
+    fdatasync(s->fd);
+    s->syncs++;
+    close(s->fd);
+}
@@ -0,0 +1,57 @@
+#ifndef SINK_H_INCLUDED
+#define SINK_H_INCLUDED
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#define SINK_MAX_IOV 64     // Segments coalesced into one pwritev
+
+/*
+ * file_sink: output file writer for the receiver.
+ *
+ * Contiguous writes are gathered into one pwritev instead of a
+ * fseek/fwrite/fflush per segment. The caller's buffer is referenced, not
+ * copied, until the run is flushed; `owner` (if not NULL) is handed to the
+ * release callback once its bytes are on their way to disk.
+ *
+ * With a preallocation size the file is fallocate'd and memory-mapped, and
+ * writes become a memcpy into the mapping (which grows on demand).
+ *
+ * Durability is periodic: every sync_interval_ms the written data is
+ * fdatasync'd (or msync'd) rather than flushed after every segment.
+ *
+ * A shared sink writes one range of a file other sinks fill the rest of
+ * (a striped transfer): the file is neither truncated on open nor trimmed
+ * on close, and it is never preallocated.
+ */
+typedef struct {
+    int fd;
+    void (*release)(void *owner);   // frees a segment's buffer once written
+
+    // Pending contiguous run
+    struct iovec iov[SINK_MAX_IOV];
+    void *owners[SINK_MAX_IOV];
+    int niov;
+    off_t run_offset;               // file offset of the first pending byte
+    size_t run_len;
+
+    // Optional mmap'd output
+    char *map;
+    size_t map_len;
+
+    off_t end;                      // highest offset written so far (final file size)
+    int shared;                     // other sinks write other ranges of the file
+    int sync_interval_ms;           // 0 disables periodic syncs
+    uint64_t last_sync_ms;
+
+    unsigned long writes;           // pwritev calls issued
+    unsigned long syncs;            // fdatasync/msync calls issued
+} file_sink;
+
+void sink_open(file_sink *s, const char *path, off_t prealloc, int sync_interval_ms, int shared);
+void sink_write(file_sink *s, off_t offset, const void *data, size_t len, void *owner);
+void sink_flush(file_sink *s);      // writes the pending run; syncs if the interval elapsed
+void sink_close(file_sink *s);      // flushes, syncs and (unless shared) trims the file to its final size
+
+#endif
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "event.h"
+#include "stats.h"
+
+void stats_open(stats_region *r, int role, int nworkers, int nslots, const char *cc_name)
+{
+    int fd;
+    char *map = MAP_FAILED;
+
+    memset(r, 0, sizeof(*r));
+    r->len = sizeof(stats_header) + nworkers * sizeof(stats_worker) + nslots * sizeof(stats_conn);
+    snprintf(r->path, sizeof(r->path), "/%s%s.%d", STATS_SHM_PREFIX,
+             role == STATS_SENDER ? "sender" : "receiver", (int)getpid());
+
+    // A fresh tmpfs file reads as zeros and only the pages touched take memory
+    fd = shm_open(r->path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        if (ftruncate(fd, r->len) == 0) {
+            map = mmap(NULL, r->len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+    }
+    if (map == MAP_FAILED) {
+        VLOG(WARNING, "Cannot publish metrics in /dev/shm%s: %s", r->path, strerror(errno));
+        if (fd >= 0) {
+            shm_unlink(r->path);
+        }
+        r->path[0] = '\0';
+        map = mmap(NULL, r->len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED) {
+            error("mmap");
+        }
+    }
+
+    r->hdr = (stats_header *)map;
+    r->workers = (stats_worker *)(map + sizeof(stats_header));
+    r->conns = (stats_conn *)(map + sizeof(stats_header) + nworkers * sizeof(stats_worker));
+    r->hdr->version = STATS_VERSION;
+    r->hdr->role = role;
+    r->hdr->pid = getpid();
+    r->hdr->nworkers = nworkers;
+    r->hdr->nslots = nslots;
+    r->hdr->start_us = now_us();
+    if (cc_name != NULL) {
+        strncpy(r->hdr->cc_name, cc_name, sizeof(r->hdr->cc_name) - 1);
+    }
+    // Readers ignore the region until the magic says the header is complete
+    __atomic_store_n(&r->hdr->magic, STATS_MAGIC, __ATOMIC_RELEASE);
+}
+
+void stats_close(stats_region *r)
+{
+    if (r->hdr == NULL) {
+        return;
+    }
+    munmap(r->hdr, r->len);
+    if (r->path[0] != '\0') {
+        shm_unlink(r->path);
+    }
+    r->hdr = NULL;
+}
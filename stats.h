@@ -0,0 +1,164 @@
+#ifndef STATS_H_INCLUDED
+#define STATS_H_INCLUDED
+
+#include <stdint.h>
+
+#define STATS_MAGIC       0x52445453  // "RDTS"
+#define STATS_VERSION     3
+#define STATS_SHM_PREFIX  "rdt_"      // regions are /dev/shm/rdt_<role>.<pid>
+#define STATS_SLOTS_PER_WORKER 1024   // receiver: connections a worker publishes at once
+
+#define STATS_SENDER   1
+#define STATS_RECEIVER 2
+
+// Connection slot states
+#define STATS_FREE     0
+#define STATS_ACTIVE   1
+#define STATS_DONE     2
+
+/*
+ * HDR-style RTT histogram: values below 2^STATS_HIST_SUB_BITS microseconds
+ * get a bucket each; above that every power of two is split into
+ * 2^STATS_HIST_SUB_BITS buckets, so a bucket is never wider than 1/16 of
+ * its lower bound. Covers up to 2^32 us; larger values land in the last
+ * bucket.
+ */
+#define STATS_HIST_SUB_BITS 4
+#define STATS_HIST_SUB      (1 << STATS_HIST_SUB_BITS)
+#define STATS_HIST_MAX_MSB  31
+#define STATS_HIST_BUCKETS  ((STATS_HIST_MAX_MSB - STATS_HIST_SUB_BITS + 2) << STATS_HIST_SUB_BITS)
+
+static inline int stats_hist_index(uint64_t v)
+{
+    int msb, shift;
+
+    if (v < STATS_HIST_SUB) {
+        return v;
+    }
+    msb = 63 - __builtin_clzll(v);
+    if (msb > STATS_HIST_MAX_MSB) {
+        return STATS_HIST_BUCKETS - 1;
+    }
+    shift = msb - STATS_HIST_SUB_BITS;
+    return ((shift + 1) << STATS_HIST_SUB_BITS) + (int)(v >> shift) - STATS_HIST_SUB;
+}
+
+static inline void stats_hist_add(uint64_t *hist, uint64_t v)
+{
+    hist[stats_hist_index(v)]++;
+}
+
+// Smallest value that lands in bucket i
+static inline uint64_t stats_hist_lower(int i)
+{
+    int shift = (i >> STATS_HIST_SUB_BITS) - 1;
+
+    if (shift < 0) {
+        return i;
+    }
+    return (uint64_t)((i & (STATS_HIST_SUB - 1)) + STATS_HIST_SUB) << shift;
+}
+
+/*
+ * Live metrics in shared memory.
+ *
+ * rdt_sender and rdt_receiver each create /dev/shm/rdt_<role>.<pid> and
+ * keep their counters there, in place: the hot path does the same plain
+ * increments and stores it would do on private memory, and nothing is
+ * copied or locked. rdt_stat maps the region read-only and computes rates
+ * from successive snapshots. Every field has exactly one writer thread
+ * (the worker that owns the connection), and 64-bit aligned stores do not
+ * tear, so a reader sees each value whole; it may see two counters at
+ * slightly different instants.
+ *
+ * The region is the header, then nworkers stats_worker entries, then
+ * nslots stats_conn entries. It is removed when the process exits normally.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t role;                // STATS_SENDER or STATS_RECEIVER
+    int32_t pid;
+    uint32_t nworkers;
+    uint32_t nslots;
+    uint64_t start_us;           // process start, on the now_us() clock (CLOCK_MONOTONIC)
+    char cc_name[16];            // sender: congestion control module
+} stats_header;
+
+typedef struct {
+    uint64_t send_syscalls;      // sendmmsg/sendto calls
+    uint64_t recv_syscalls;      // recvfrom/recvmmsg calls
+    uint64_t loop_syscalls;      // sender: epoll_wait and timerfd calls
+    uint64_t write_syscalls;     // receiver: pwritev and sync calls
+    uint64_t datagrams_sent;
+    uint64_t datagrams_received;
+    uint64_t corrupt;            // datagrams dropped as truncated or failing their CRC32C
+    uint64_t pad;                // one cache line per worker
+} stats_worker;
+
+typedef struct {
+    uint64_t bytes_sent;         // payload bytes put on the wire, retransmissions included
+    uint64_t segments_sent;
+    uint64_t bytes_acked;        // cumulatively ACKed
+    uint64_t retx_fast;          // retransmissions during fast (SACK) recovery
+    uint64_t retx_timeout;       // retransmissions of segments the RTO declared lost
+    uint64_t timeouts;
+    uint64_t dup_acks;
+    double cwnd;
+    int32_t ssthresh;
+    int32_t pipe;                // segments in flight
+    int32_t cc_state;            // SLOW_START, CONGESTION_AVOIDANCE or FAST_RETRANSMIT
+    int32_t fec_k;               // parity segments per block being sent (-F)
+    uint64_t parity_sent;
+    uint64_t rebuilt;            // segments the receiver rebuilt from parity, per its ACKs
+    double loss_rate;            // what fec_k is chosen from
+    uint64_t state_since_us;     // when cc_state was entered (now_us() clock)
+    uint64_t state_us[3];        // time spent in each state before that
+    int64_t srtt_us;
+    int64_t rto_us;
+    uint64_t rtt_samples;
+    uint64_t rtt_hist[STATS_HIST_BUCKETS];
+} stats_sender_conn;
+
+typedef struct {
+    uint64_t bytes_received;     // in-window payload bytes, duplicates excluded
+    uint64_t segments_received;  // every data segment, duplicates included
+    uint64_t duplicates;         // segments already held or delivered
+    uint64_t out_of_order;       // segments buffered beyond a hole
+    uint64_t acks_sent;
+    uint64_t writes;             // pwritev and sync calls for this connection
+    uint64_t parity_received;
+    uint64_t rebuilt;            // segments rebuilt from parity
+    int32_t held_segments;       // reassembly buffer occupancy
+    int32_t max_held_segments;
+    uint32_t file_crc;           // CRC32C of the data written, once the EOF is in
+    int32_t verified;            // 1 if it matched the sender's, -1 if not, 0 before the EOF
+} stats_receiver_conn;
+
+typedef struct {
+    int32_t state;               // STATS_FREE, STATS_ACTIVE or STATS_DONE
+    int32_t conn_id;
+    int32_t worker;
+    int32_t pad;
+    uint64_t start_us;
+    uint64_t end_us;             // when it finished, 0 while active
+    union {
+        stats_sender_conn s;
+        stats_receiver_conn r;
+    };
+} stats_conn;
+
+typedef struct {
+    stats_header *hdr;
+    stats_worker *workers;
+    stats_conn *conns;
+    size_t len;
+    char path[64];
+} stats_region;
+
+// Creates and maps /dev/shm/rdt_<role>.<pid>; on failure the counters go to
+// private memory instead, and nothing is published
+void stats_open(stats_region *r, int role, int nworkers, int nslots, const char *cc_name);
+void stats_close(stats_region *r);       // unmaps and removes the region
+
+#endif
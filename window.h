@@ -1,18 +1,48 @@
+#ifndef WINDOW_H_INCLUDED
+#define WINDOW_H_INCLUDED
+
+#include <stdint.h>
+
 #include"packet.h"
 
+/*
+ * Retransmission queue: one entry per outstanding segment, kept in a ring
+ * indexed by segment number (seqno / DATA_SIZE). Segments start DATA_SIZE
+ * apart, so inserting, finding and removing a segment touch exactly one
+ * slot, and the head always holds the smallest outstanding sequence number.
+ * A cumulative ACK pops entries off the head.
+ *
+ * An entry keeps the header as sent and a pointer to the payload, which
+ * stays wherever the caller keeps it (a file mapping, a stream buffer).
+ * Each window is self-contained, so any number of them can coexist.
+ */
+typedef struct {
+    tcp_header hdr;          // header as sent; hdr.data_size is the payload length, 0 for a free slot
+    const char *payload;
+    uint32_t crc;            // CRC32C of the payload, computed once for every transmission
+    int state;               // caller-defined flags, e.g. a SACK scoreboard
+    uint64_t sent_us;        // microsecond send time of the latest transmission
+    uint64_t delivered;      // delivery-rate snapshot taken at that transmission:
+    uint64_t delivered_us;   //   bytes delivered so far, when the last of them was,
+    uint64_t first_sent_us;  //   and when the newest of them had been sent
+} window_entry;
+
 typedef struct {
-    unsigned int window_size;
-    // unsigned int buffer[window_size];
-    void* buffer_ptr;
-    unsigned int smallest_seqno_idx; // index in the buffer array at which the packet of smallest sequence number is stored
+    unsigned int window_size;   // capacity in segments, a power of two
+    unsigned int mask;          // window_size - 1
+    window_entry *entries;
+    unsigned int head;          // segment number of the smallest outstanding seqno
+    unsigned int tail;          // one past the highest segment number inserted
+    unsigned int count;         // entries in use
 } window;
 
-window* set_window(unsigned int window_size); // sets the window according to the window size given
-int buffer_full(window *window);              // checks whether the buffer is full; returns 1 if full, -1 otherwise
-void add_packet_to_buffer(tcp_packet *pkt);         // adds the packet to the buffer at smallest index
-void remove_packet_from_buffer(int seqno);    // removes the packet with the given sequence number from the buffer
-// tcp_packet* find_packet(int seqno);           // finds a packet with the given sequence number in the buffer, and returns a pointer to that packets
-tcp_packet* return_packet_of_smallest_seqno(); // returns a pointer to a packet with the smallest sequence number in the buffer; used in packet retransmission
+window* set_window(unsigned int window_size); // creates a window of at least window_size segments
+void free_window(window *w);
+int buffer_full(window *w);                   // checks whether the buffer is full; returns 1 if full, -1 otherwise
+window_entry* add_packet_to_buffer(window *w, int seqno, const char *payload, int len); // NULL if seqno does not fit
+void remove_packet_from_buffer(window *w, int seqno);  // removes the packet with the given sequence number from the buffer
+int remove_acked_packets(window *w, int ackno);        // removes every packet ending at or below ackno; returns how many
+window_entry* find_packet(window *w, int seqno);       // the packet with the given sequence number, or NULL
+window_entry* return_packet_of_smallest_seqno(window *w); // the oldest outstanding packet, or NULL when empty
 
-// int find_buffer_space(window *window);        // checks whether the buffer has space left, and returns the smallest index of empty slot in the buffer array;
-//                                               // if buffer is full, return -1
\ No newline at end of file
+#endif
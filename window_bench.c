@@ -0,0 +1,67 @@
+/*
+ * window_bench: cost of one send/ACK cycle on the retransmission queue as
+ * the window grows. Each cycle looks up the oldest packet, looks up a
+ * random outstanding packet (as SACK processing does), removes the oldest
+ * one with a cumulative ACK, and inserts a new packet at the tail.
+ *
+ * usage: window_bench [cycles]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "window.h"
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    static const unsigned int sizes[] = {10, 100, 1000, 10000, 100000};
+    long cycles = argc > 1 ? atol(argv[1]) : 500000;
+    static char payload[DATA_SIZE];
+    long checksum = 0;
+
+    printf("%10s %12s\n", "window", "ns/cycle");
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        window *w = set_window(sizes[s]);
+        int next_seqno = 0;
+
+        // Start from a full window
+        while (buffer_full(w) != 1) {
+            add_packet_to_buffer(w, next_seqno, payload, DATA_SIZE);
+            next_seqno += DATA_SIZE;
+        }
+
+        srand(1);
+        double start = now_ns();
+        for (long i = 0; i < cycles; i++) {
+            window_entry *oldest = return_packet_of_smallest_seqno(w);
+            int base = oldest->hdr.seqno;
+            int span = (next_seqno - base) / DATA_SIZE;
+            window_entry *e = find_packet(w, base + (rand() % span) * DATA_SIZE);
+
+            checksum += e->hdr.seqno;
+            remove_acked_packets(w, base + DATA_SIZE);
+            e = add_packet_to_buffer(w, next_seqno, payload, DATA_SIZE);
+            e->sent_us = i;
+            next_seqno += DATA_SIZE;
+            if (next_seqno > 1 << 30) {
+                // Stay clear of int overflow; restart from an empty window
+                remove_acked_packets(w, next_seqno);
+                next_seqno = 0;
+                while (buffer_full(w) != 1) {
+                    add_packet_to_buffer(w, next_seqno, payload, DATA_SIZE);
+                    next_seqno += DATA_SIZE;
+                }
+            }
+        }
+        printf("%10u %12.1f\n", sizes[s], (now_ns() - start) / cycles);
+        free_window(w);
+    }
+    return checksum == 0;  // keep the lookups from being optimised away
+}